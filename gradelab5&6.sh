@@ -56,7 +56,12 @@ fi
 for tcase in $(ls $TESTCASEDIR/); do
     if [ ${tcase##*.} = "tig" ]; then
         tfileName=${tcase##*/}
-        ./$BIN $TESTCASEDIR/$tfileName &>/dev/null
+        # Compiler options for one testcase, if any, go in a .flags file
+        flags=""
+        if [ -f $TESTCASEDIR/${tfileName%.*}.flags ]; then
+            flags=$(cat $TESTCASEDIR/${tfileName%.*}.flags)
+        fi
+        ./$BIN $flags $TESTCASEDIR/$tfileName &>/dev/null
         gcc -Wl,--wrap,getchar -m64 $TESTCASEDIR/${tfileName}.s $RUNTIMEPATH -o test.out &>/dev/null
         if [ ! -s test.out ]; then
             echo -e "${BLUE_COLOR}[*_*]$ite: Link error. [$tfileName]${RES}"
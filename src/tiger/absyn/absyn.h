@@ -521,9 +521,11 @@ class VarDec : public Dec {
   S::Symbol *typ;
   Exp *init;
   bool escape;
+  bool assigned;
 
   VarDec(int pos, S::Symbol *var, S::Symbol *typ, Exp *init)
-      : Dec(VAR, pos), var(var), typ(typ), init(init), escape(true) {}
+      : Dec(VAR, pos), var(var), typ(typ), init(init), escape(true),
+        assigned(true) {}
   void Print(FILE *out, int d) const override;
 
   void SemAnalyze(S::Table<E::EnvEntry> *venv, S::Table<TY::Ty> *tenv,
@@ -617,9 +619,10 @@ class Field {
   int pos;
   S::Symbol *name, *typ;
   bool escape;
+  bool assigned;
 
   Field(int pos, S::Symbol *name, S::Symbol *typ)
-      : pos(pos), name(name), typ(typ), escape(true) {}
+      : pos(pos), name(name), typ(typ), escape(true), assigned(true) {}
 
   void Print(FILE *out, int d) const;
 };
@@ -1,13 +1,19 @@
 #include "tiger/canon/canon.h"
 
-namespace {
+#include <algorithm>
+#include <map>
+
+#include "tiger/frame/frame.h"
 
-S::Table<T::StmList>* block_env;
-C::Block global_block;
+/*
+ * Every pass here runs on explicit stacks and vectors instead of the C++
+ * stack, so machine-generated programs with very long sequences or huge
+ * expressions cannot overflow it. The work is done in the same order as
+ * the textbook's recursive definitions, so temps and labels are created
+ * in the same order and the output is unchanged.
+ */
 
-C::StmAndExp do_exp(T::Exp* exp);
-C::StmListList* mk_blocks(T::StmList* stms, TEMP::Label* done);
-T::StmList* get_next();
+namespace {
 
 bool is_nop(T::Stm* x) {
   //[TODO] remove judgement using "kind" property
@@ -17,39 +23,129 @@ bool is_nop(T::Stm* x) {
     return false;
 }
 
+T::Stm* nop() { return new T::ExpStm(new T::ConstExp(0)); }
+
 T::Stm* seq(T::Stm* x, T::Stm* y) {
   if (is_nop(x)) return y;
   if (is_nop(y)) return x;
   return new T::SeqStm(x, y);
 }
 
+/* The temps and memory an expression already in canonical form reads.
+ * Its loads are kept by address so stores to other frame slots can be
+ * told apart from them. */
+struct Reads {
+  std::vector<TEMP::Temp*> temps;
+  std::vector<T::Exp*> loads;
+  bool machine = false;
+};
+
+/* Words at fp+i and fp+j never overlap when i != j; nothing else is
+ * known to be disjoint */
+bool frame_slot(T::Exp* addr, int* offset) {
+  if (addr->kind != T::Exp::Kind::BINOP) return false;
+  T::BinopExp* b = static_cast<T::BinopExp*>(addr);
+  if (b->op != T::BinOp::PLUS_OP && b->op != T::BinOp::MINUS_OP) return false;
+  if (b->left->kind != T::Exp::Kind::TEMP ||
+      static_cast<T::TempExp*>(b->left)->temp != F::FP() ||
+      b->right->kind != T::Exp::Kind::CONST)
+    return false;
+  int k = static_cast<T::ConstExp*>(b->right)->consti;
+  *offset = b->op == T::BinOp::PLUS_OP ? k : -k;
+  return true;
+}
+
+bool may_alias(T::Exp* x, T::Exp* y) {
+  int i, j;
+  return !(frame_slot(x, &i) && frame_slot(y, &j) && i != j);
+}
+
+/* Fills in what e reads. False if e is too big to be worth looking at or
+ * still has a call or an ESEQ in it. */
+bool collect_reads(T::Exp* e, Reads* r) {
+  const int LIMIT = 32;
+  std::vector<T::Exp*> work{e};
+  for (int seen = 0; !work.empty(); seen++) {
+    if (seen > LIMIT) return false;
+    T::Exp* x = work.back();
+    work.pop_back();
+    switch (x->kind) {
+      case T::Exp::Kind::CONST:
+      case T::Exp::Kind::NAME:
+        break;
+      case T::Exp::Kind::TEMP: {
+        TEMP::Temp* t = static_cast<T::TempExp*>(x)->temp;
+        r->temps.push_back(t);
+        if (TEMP::inTempList(t, F::registers())) r->machine = true;
+        break;
+      }
+      case T::Exp::Kind::BINOP:
+        work.push_back(static_cast<T::BinopExp*>(x)->left);
+        work.push_back(static_cast<T::BinopExp*>(x)->right);
+        break;
+      case T::Exp::Kind::MEM:
+        r->loads.push_back(static_cast<T::MemExp*>(x)->exp);
+        work.push_back(static_cast<T::MemExp*>(x)->exp);
+        break;
+      default:
+        return false;
+    }
+  }
+  return true;
+}
+
+/* Can y, computed before x, instead be computed after it? x is canonical
+ * and y has no ESEQ or CALL left, so y only goes wrong if x assigns a temp
+ * y reads, stores to a word y loads, or calls (which may store anywhere
+ * and clobbers the machine registers). The statements of x are scanned up
+ * to a fixed budget so long hoisted sequences stay linear. */
 bool commute(T::Stm* x, T::Exp* y) {
   if (is_nop(x)) return true;
   if (y->kind == T::Exp::Kind::NAME || y->kind == T::Exp::Kind::CONST)
     return true;
-  return false;
-}
 
-T::Stm* reorder(C::ExpRefList* rlist) {
-  if (!rlist)
-    return new T::ExpStm(new T::ConstExp(0)); /* nop */
-  else if ((*rlist->head)->kind == T::Exp::Kind::CALL) {
-    TEMP::Temp* t = TEMP::Temp::NewTemp();
-    *rlist->head = new T::EseqExp(
-        new T::MoveStm(new T::TempExp(t), *rlist->head), new T::TempExp(t));
-    return reorder(rlist);
-  } else {
-    C::StmAndExp hd = do_exp(*rlist->head);
-    T::Stm* s = reorder(rlist->tail);
-    if (commute(s, hd.e)) {
-      *rlist->head = hd.e;
-      return seq(hd.s, s);
-    } else {
-      TEMP::Temp* t = TEMP::Temp::NewTemp();
-      *rlist->head = new T::TempExp(t);
-      return seq(hd.s, seq(new T::MoveStm(new T::TempExp(t), hd.e), s));
+  Reads reads;
+  if (!collect_reads(y, &reads)) return false;
+
+  const int LIMIT = 64;
+  std::vector<T::Stm*> work{x};
+  for (int seen = 0; !work.empty(); seen++) {
+    if (seen > LIMIT) return false;
+    T::Stm* s = work.back();
+    work.pop_back();
+    bool call = false;
+    switch (s->kind) {
+      case T::Stm::Kind::SEQ:
+        work.push_back(static_cast<T::SeqStm*>(s)->left);
+        work.push_back(static_cast<T::SeqStm*>(s)->right);
+        break;
+      case T::Stm::Kind::MOVE: {
+        T::MoveStm* m = static_cast<T::MoveStm*>(s);
+        call = m->src->kind == T::Exp::Kind::CALL;
+        if (m->dst->kind == T::Exp::Kind::TEMP) {
+          TEMP::Temp* t = static_cast<T::TempExp*>(m->dst)->temp;
+          if (std::find(reads.temps.begin(), reads.temps.end(), t) !=
+              reads.temps.end())
+            return false;
+        } else if (m->dst->kind == T::Exp::Kind::MEM) {
+          T::Exp* addr = static_cast<T::MemExp*>(m->dst)->exp;
+          for (T::Exp* load : reads.loads)
+            if (may_alias(addr, load)) return false;
+        } else {
+          return false;
+        }
+        break;
+      }
+      case T::Stm::Kind::EXP:
+        call = static_cast<T::ExpStm*>(s)->exp->kind == T::Exp::Kind::CALL;
+        break;
+      default:
+        /* labels and jumps only decide which of the other statements run */
+        break;
     }
+    if (call && (reads.machine || !reads.loads.empty())) return false;
   }
+  return true;
 }
 
 C::ExpRefList* get_call_rlist(T::Exp* exp) {
@@ -64,137 +160,240 @@ C::ExpRefList* get_call_rlist(T::Exp* exp) {
     return rlist;
 }
 
-/* processes stm so that it contains no ESEQ nodes */
-T::Stm* do_stm(T::Stm* stm) { return stm->Canon(stm); }
-
-C::StmAndExp do_exp(T::Exp* exp) { return exp->Canon(exp); }
+/* One pending call of do_stm, do_exp or reorder. `state` says where it
+ * resumes once the call it made returns; s and e keep what it computed
+ * before that call. */
+struct Frame {
+  enum Kind { STM, EXP, REORDER };
+
+  Kind kind;
+  int state;
+  T::Stm* stm;
+  T::Exp* exp;
+  C::ExpRefList* rlist;
+  T::Stm* s;
+  T::Exp* e;
+
+  Frame(Kind kind, T::Stm* stm, T::Exp* exp, C::ExpRefList* rlist)
+      : kind(kind), state(0), stm(stm), exp(exp), rlist(rlist), s(nullptr),
+        e(nullptr) {}
+};
+
+/* Removes the ESEQs of a statement (kind STM) or of an expression (kind
+ * EXP, giving the statements to run first in the result's stm and the
+ * value in its exp). The cases follow the textbook's do_stm, do_exp and
+ * reorder, with every recursive call pushed on `stack`. */
+class Canonicalizer {
+ public:
+  C::StmAndExp Run(Frame frame) {
+    stack.push_back(frame);
+    while (!stack.empty()) {
+      switch (stack.back().kind) {
+        case Frame::STM:
+          StepStm();
+          break;
+        case Frame::EXP:
+          StepExp();
+          break;
+        case Frame::REORDER:
+          StepReorder();
+          break;
+      }
+    }
+    return C::StmAndExp(retStm, retExp);
+  }
 
-/* linear gets rid of the top-level SEQ's, producing a list */
-T::StmList* linear(T::Stm* stm, T::StmList* right) {
-  if (stm->kind == T::Stm::Kind::SEQ) {
-    T::SeqStm* seqstm = dynamic_cast<T::SeqStm*>(stm);
-    if (!seqstm) assert(0);
-    return linear(seqstm->left, linear(seqstm->right, right));
-  } else
-    return new T::StmList(stm, right);
-}
+ private:
+  std::vector<Frame> stack;
+  T::Stm* retStm = nullptr;
+  T::Exp* retExp = nullptr;
 
-/* Go down a list looking for end of basic block */
-C::StmListList* next(T::StmList* prevstms, T::StmList* stms,
-                     TEMP::Label* done) {
-  if (!stms)
-    return next(
-        prevstms,
-        new T::StmList(new T::JumpStm(new T::NameExp(done),
-                                      new TEMP::LabelList(done, nullptr)),
-                       nullptr),
-        done);
-  if (stms->head->kind == T::Stm::Kind::JUMP ||
-      stms->head->kind == T::Stm::Kind::CJUMP) {
-    C::StmListList* stmLists;
-    prevstms->tail = stms;
-    stmLists = mk_blocks(stms->tail, done);
-    stms->tail = nullptr;
-    return stmLists;
-  } else if (stms->head->kind == T::Stm::Kind::LABEL) {
-    T::LabelStm* labelstm = dynamic_cast<T::LabelStm*>(stms->head);
-    if (!labelstm) assert(0);
-    TEMP::Label* lab = labelstm->label;
-    return next(
-        prevstms,
-        new T::StmList(new T::JumpStm(new T::NameExp(lab),
-                                      new TEMP::LabelList(lab, nullptr)),
-                       stms),
-        done);
-  } else {
-    prevstms->tail = stms;
-    return next(stms, stms->tail, done);
+  void Call(int resume, Frame frame) {
+    stack.back().state = resume;
+    stack.push_back(frame);
   }
-}
 
-/* Create the beginning of a basic block */
-C::StmListList* mk_blocks(T::StmList* stms, TEMP::Label* done) {
-  if (!stms) {
-    return nullptr;
+  void Return(T::Stm* stm, T::Exp* exp = nullptr) {
+    retStm = stm;
+    retExp = exp;
+    stack.pop_back();
   }
-  if (stms->head->kind != T::Stm::Kind::LABEL) {
-    return mk_blocks(new T::StmList(new T::LabelStm(TEMP::NewLabel()), stms),
-                     done);
+
+  // reorder(rlist) and then seq(that, the statement) or (that, the
+  // expression), in state 1
+  void Reorder(C::ExpRefList* rlist) {
+    Call(1, Frame(Frame::REORDER, nullptr, nullptr, rlist));
   }
-  /* else there already is a label */
-  return new C::StmListList(stms, next(stms, stms->tail, done));
-}
 
-T::StmList* get_last(T::StmList* list) {
-  T::StmList* last = list;
-  while (last->tail->tail) last = last->tail;
-  return last;
-}
+  void StepStm() {
+    Frame& f = stack.back();
+    T::Stm* stm = f.stm;
+    if (f.state == 1) {
+      Return(seq(retStm, stm));
+      return;
+    }
+    switch (stm->kind) {
+      case T::Stm::Kind::SEQ: {
+        // The right half first, the order g++ evaluated the arguments of
+        // seq(do_stm(left), do_stm(right)) in
+        T::SeqStm* seqstm = static_cast<T::SeqStm*>(stm);
+        if (f.state == 0) {
+          Call(2, Frame(Frame::STM, seqstm->right, nullptr, nullptr));
+        } else if (f.state == 2) {
+          f.s = retStm;
+          Call(3, Frame(Frame::STM, seqstm->left, nullptr, nullptr));
+        } else {
+          Return(seq(retStm, f.s));
+        }
+        break;
+      }
+      case T::Stm::Kind::LABEL:
+        Return(stm);
+        break;
+      case T::Stm::Kind::JUMP: {
+        T::JumpStm* jumpstm = static_cast<T::JumpStm*>(stm);
+        Reorder(new C::ExpRefList((T::Exp**)&jumpstm->exp, nullptr));
+        break;
+      }
+      case T::Stm::Kind::CJUMP: {
+        T::CjumpStm* cjumpstm = static_cast<T::CjumpStm*>(stm);
+        Reorder(new C::ExpRefList(
+            &cjumpstm->left, new C::ExpRefList(&cjumpstm->right, nullptr)));
+        break;
+      }
+      case T::Stm::Kind::MOVE: {
+        T::MoveStm* movestm = static_cast<T::MoveStm*>(stm);
+        if (movestm->dst->kind == T::Exp::Kind::TEMP &&
+            movestm->src->kind == T::Exp::Kind::CALL)
+          Reorder(get_call_rlist(movestm->src));
+        else if (movestm->dst->kind == T::Exp::Kind::TEMP)
+          Reorder(new C::ExpRefList(&movestm->src, nullptr));
+        else if (movestm->dst->kind == T::Exp::Kind::MEM) {
+          T::MemExp* memexp = static_cast<T::MemExp*>(movestm->dst);
+          Reorder(new C::ExpRefList(
+              &memexp->exp, new C::ExpRefList(&movestm->src, nullptr)));
+        } else if (movestm->dst->kind == T::Exp::Kind::ESEQ) {
+          T::EseqExp* eseqexp = static_cast<T::EseqExp*>(movestm->dst);
+          movestm->dst = eseqexp->exp;
+          f.stm = new T::SeqStm(eseqexp->stm, movestm);
+        } else
+          assert(0); /* dst should be temp or mem only */
+        break;
+      }
+      case T::Stm::Kind::EXP: {
+        T::ExpStm* expstm = static_cast<T::ExpStm*>(stm);
+        if (expstm->exp->kind == T::Exp::Kind::CALL)
+          Reorder(get_call_rlist(expstm->exp));
+        else
+          Reorder(new C::ExpRefList(&expstm->exp, nullptr));
+        break;
+      }
+    }
+  }
 
-void trace(T::StmList* list) {
-  T::StmList* last = get_last(list);
-  T::LabelStm* lab = dynamic_cast<T::LabelStm*>(list->head);
-  if (!lab) assert(0);
-  T::Stm* s = last->tail->head;
-  block_env->Enter(lab->label, nullptr);
-  if (s->kind == T::Stm::Kind::JUMP) {
-    T::JumpStm* jumpstm = dynamic_cast<T::JumpStm*>(s);
-    if (!jumpstm) assert(0);
-    T::StmList* target = (T::StmList*)block_env->Look(jumpstm->jumps->head);
-    if (!jumpstm->jumps->tail && target) {
-      last->tail = target; /* merge the 2 lists removing JUMP stm */
-      trace(target);
-    } else
-      last->tail->tail = get_next(); /* merge and keep JUMP stm */
+  void StepExp() {
+    Frame& f = stack.back();
+    T::Exp* exp = f.exp;
+    if (f.state == 1) {
+      Return(retStm, exp);
+      return;
+    }
+    switch (exp->kind) {
+      case T::Exp::Kind::BINOP: {
+        T::BinopExp* binopexp = static_cast<T::BinopExp*>(exp);
+        Reorder(new C::ExpRefList(
+            &binopexp->left, new C::ExpRefList(&binopexp->right, nullptr)));
+        break;
+      }
+      case T::Exp::Kind::MEM:
+        Reorder(new C::ExpRefList(&static_cast<T::MemExp*>(exp)->exp, nullptr));
+        break;
+      case T::Exp::Kind::TEMP:
+      case T::Exp::Kind::NAME:
+      case T::Exp::Kind::CONST:
+        Return(nop(), exp);
+        break;
+      case T::Exp::Kind::ESEQ: {
+        // The value first, then the statement in front of it
+        T::EseqExp* eseqexp = static_cast<T::EseqExp*>(exp);
+        if (f.state == 0) {
+          Call(2, Frame(Frame::EXP, nullptr, eseqexp->exp, nullptr));
+        } else if (f.state == 2) {
+          f.s = retStm;
+          f.e = retExp;
+          Call(3, Frame(Frame::STM, eseqexp->stm, nullptr, nullptr));
+        } else {
+          Return(seq(retStm, f.s), f.e);
+        }
+        break;
+      }
+      case T::Exp::Kind::CALL:
+        Reorder(get_call_rlist(exp));
+        break;
+    }
   }
-  /* we want false label to follow CJUMP */
-  else if (s->kind == T::Stm::Kind::CJUMP) {
-    T::CjumpStm* cjumpstm = dynamic_cast<T::CjumpStm*>(s);
-    if (!cjumpstm) assert(0);
-    T::StmList* truelist = (T::StmList*)block_env->Look(cjumpstm->true_label);
-    T::StmList* falselist = (T::StmList*)block_env->Look(cjumpstm->false_label);
-    if (falselist) {
-      last->tail->tail = falselist;
-      trace(falselist);
-    } else if (truelist) { /* convert so that existing label is a false label */
-      last->tail->head = new T::CjumpStm(
-          T::notRel(cjumpstm->op), cjumpstm->left, cjumpstm->right,
-          cjumpstm->false_label, cjumpstm->true_label);
-      last->tail->tail = truelist;
-      trace(truelist);
+
+  void StepReorder() {
+    Frame& f = stack.back();
+    C::ExpRefList* rlist = f.rlist;
+    if (f.state == 0) {
+      if (!rlist) {
+        Return(nop());
+      } else if ((*rlist->head)->kind == T::Exp::Kind::CALL) {
+        TEMP::Temp* t = TEMP::Temp::NewTemp();
+        *rlist->head = new T::EseqExp(
+            new T::MoveStm(new T::TempExp(t), *rlist->head), new T::TempExp(t));
+      } else {
+        Call(1, Frame(Frame::EXP, nullptr, *rlist->head, nullptr));
+      }
+    } else if (f.state == 1) {
+      f.s = retStm;
+      f.e = retExp;
+      Call(2, Frame(Frame::REORDER, nullptr, nullptr, rlist->tail));
     } else {
-      TEMP::Label* falselabel = TEMP::NewLabel();
-      last->tail->head =
-          new T::CjumpStm(cjumpstm->op, cjumpstm->left, cjumpstm->right,
-                          cjumpstm->true_label, falselabel);
-      last->tail->tail = new T::StmList(
-          new T::LabelStm(falselabel),
-          new T::StmList(new T::JumpStm(new T::NameExp(cjumpstm->false_label),
-                                        new TEMP::LabelList(
-                                            cjumpstm->false_label, nullptr)),
-                         get_next()));
+      T::Stm* s = retStm;
+      if (commute(s, f.e)) {
+        *rlist->head = f.e;
+        Return(seq(f.s, s));
+      } else {
+        TEMP::Temp* t = TEMP::Temp::NewTemp();
+        *rlist->head = new T::TempExp(t);
+        Return(seq(f.s, seq(new T::MoveStm(new T::TempExp(t), f.e), s)));
+      }
     }
-  } else
-    assert(0);
+  }
+};
+
+/* processes stm so that it contains no ESEQ nodes */
+T::Stm* do_stm(T::Stm* stm) {
+  return Canonicalizer().Run(Frame(Frame::STM, stm, nullptr, nullptr)).s;
 }
 
-/* get the next block from the list of stmLists, using only those that have
- * not been traced yet */
-T::StmList* get_next() {
-  if (!global_block.stmLists)
-    return new T::StmList(new T::LabelStm(global_block.label), nullptr);
-  else {
-    T::StmList* s = global_block.stmLists->head;
-    T::LabelStm* lab = dynamic_cast<T::LabelStm*>(s->head);
-    if (!lab) assert(0);
-    if (block_env->Look(lab->label)) { /* label exists in the table */
-      trace(s);
-      return s;
-    } else {
-      global_block.stmLists = global_block.stmLists->tail;
-      return get_next();
-    }
+/* linear gets rid of the top-level SEQ's, producing a list */
+T::StmList* linear(T::Stm* stm, T::StmList* right) {
+  std::vector<T::Stm*> stack(1, stm);
+  while (!stack.empty()) {
+    T::Stm* s = stack.back();
+    stack.pop_back();
+    if (s->kind == T::Stm::Kind::SEQ) {
+      T::SeqStm* seqstm = static_cast<T::SeqStm*>(s);
+      stack.push_back(seqstm->left);
+      stack.push_back(seqstm->right);
+    } else
+      right = new T::StmList(s, right);
   }
+  return right;
+}
+
+T::Stm* jump_to(TEMP::Label* label) {
+  return new T::JumpStm(new T::NameExp(label),
+                        new TEMP::LabelList(label, nullptr));
+}
+
+T::StmList* get_last(T::StmList* list) {
+  T::StmList* last = list;
+  while (last->tail->tail) last = last->tail;
+  return last;
 }
 
 }  // namespace
@@ -221,8 +420,41 @@ T::StmList* Linearize(T::Stm* stm) { return linear(do_stm(stm), nullptr); }
 Block BasicBlocks(T::StmList* stmList) {
   Block b;
   b.label = TEMP::NewLabel();
-  b.stmLists = mk_blocks(stmList, b.label);
+  std::vector<T::StmList*> blocks;
+  T::StmList* stms = stmList;
+  while (stms) {
+    /* Create the beginning of a basic block */
+    if (stms->head->kind != T::Stm::Kind::LABEL)
+      stms = new T::StmList(new T::LabelStm(TEMP::NewLabel()), stms);
+    blocks.push_back(stms);
+    /* Go down the list looking for the end of the block */
+    T::StmList* prevstms = stms;
+    stms = stms->tail;
+    for (;;) {
+      if (!stms) {
+        prevstms->tail = new T::StmList(jump_to(b.label), nullptr);
+        break;
+      }
+      if (stms->head->kind == T::Stm::Kind::JUMP ||
+          stms->head->kind == T::Stm::Kind::CJUMP) {
+        T::StmList* rest = stms->tail;
+        stms->tail = nullptr;
+        stms = rest;
+        break;
+      }
+      if (stms->head->kind == T::Stm::Kind::LABEL) {
+        TEMP::Label* lab = static_cast<T::LabelStm*>(stms->head)->label;
+        prevstms->tail = new T::StmList(jump_to(lab), nullptr);
+        break;
+      }
+      prevstms = stms;
+      stms = stms->tail;
+    }
+  }
 
+  b.stmLists = nullptr;
+  for (auto it = blocks.rbegin(); it != blocks.rend(); ++it)
+    b.stmLists = new StmListList(*it, b.stmLists);
   return b;
 }
 
@@ -237,98 +469,79 @@ Block BasicBlocks(T::StmList* stmList) {
    as possible are eliminated by falling through into T.LABEL(lab).
 */
 T::StmList* TraceSchedule(Block b) {
-  StmListList* sList;
-  block_env = new S::Table<T::StmList>();
-  global_block = b;
+  int n = 0;
+  for (StmListList* sList = b.stmLists; sList; sList = sList->tail) n++;
+  return TraceSchedule(b, std::vector<double>(n, 0));
+}
 
-  for (sList = global_block.stmLists; sList; sList = sList->tail) {
+T::StmList* TraceSchedule(Block b, const std::vector<double>& freq) {
+  std::vector<T::StmList*> blocks;
+  std::map<TEMP::Label*, int> index;
+  for (StmListList* sList = b.stmLists; sList; sList = sList->tail) {
     T::LabelStm* lab = dynamic_cast<T::LabelStm*>(sList->head->head);
     if (!lab) assert(0);
-    block_env->Enter(lab->label, sList->head);
+    index[lab->label] = blocks.size();
+    blocks.push_back(sList->head);
   }
-
-  return get_next();
-}
-
-}  // namespace C
-
-namespace T {
-
-/* processes stm so that it contains no ESEQ nodes */
-Stm* SeqStm::Canon(Stm* self) {
-  return seq(do_stm(this->left), do_stm(this->right));
-}
-
-Stm* LabelStm::Canon(Stm* self) { return self; }
-
-Stm* JumpStm::Canon(Stm* self) {
-  return seq(reorder(new C::ExpRefList((T::Exp**)&this->exp, nullptr)), self);
-}
-
-Stm* CjumpStm::Canon(Stm* self) {
-  return seq(reorder(new C::ExpRefList(
-                 &this->left, new C::ExpRefList(&this->right, nullptr))),
-             self);
-}
-
-Stm* MoveStm::Canon(Stm* self) {
-  if (this->dst->kind == Exp::Kind::TEMP && this->src->kind == Exp::Kind::CALL)
-    return seq(reorder(get_call_rlist(this->src)), self);
-  else if (this->dst->kind == Exp::Kind::TEMP)
-    return seq(reorder(new C::ExpRefList(&this->src, nullptr)), self);
-  else if (this->dst->kind == Exp::Kind::MEM) {
-    MemExp* memexp = dynamic_cast<MemExp*>(this->dst);
-    if (!memexp) assert(0);
-    return seq(reorder(new C::ExpRefList(
-                   &memexp->exp, new C::ExpRefList(&this->src, nullptr))),
-               self);
-  } else if (this->dst->kind == Exp::Kind::ESEQ) {
-    EseqExp* eseqexp = dynamic_cast<EseqExp*>(this->dst);
-    if (!eseqexp) assert(0);
-    Stm* s = eseqexp->stm;
-    this->dst = eseqexp->exp;
-    return do_stm(new SeqStm(s, self));
+  int n = blocks.size();
+  assert((int)freq.size() == n);
+
+  std::vector<int> seeds;
+  for (int i = 0; i < n; i++) seeds.push_back(i);
+  if (n > 1)
+    std::stable_sort(seeds.begin() + 1, seeds.end(),
+                     [&freq](int x, int y) { return freq[x] > freq[y]; });
+
+  std::vector<bool> placed(n, false);
+  auto unplaced = [&](TEMP::Label* label) {
+    auto it = index.find(label);
+    return it != index.end() && !placed[it->second] ? it->second : -1;
+  };
+  T::StmList head(nullptr, nullptr);
+  T::StmList* tail = &head;
+  for (int seed : seeds) {
+    for (int cur = seed; cur >= 0 && !placed[cur];) {
+      placed[cur] = true;
+      tail->tail = blocks[cur];
+      T::StmList* prev = get_last(blocks[cur]);
+      T::Stm* s = prev->tail->head;
+      tail = prev->tail;
+      cur = -1;
+      if (s->kind == T::Stm::Kind::JUMP) {
+        T::JumpStm* jumpstm = static_cast<T::JumpStm*>(s);
+        int target = unplaced(jumpstm->jumps->head);
+        if (!jumpstm->jumps->tail && target >= 0) {
+          prev->tail = nullptr; /* fall through, removing the JUMP */
+          tail = prev;
+          cur = target;
+        }
+      } else if (s->kind == T::Stm::Kind::CJUMP) {
+        T::CjumpStm* cjumpstm = static_cast<T::CjumpStm*>(s);
+        int t = unplaced(cjumpstm->true_label);
+        int f = unplaced(cjumpstm->false_label);
+        if (f >= 0 && (t < 0 || freq[f] >= freq[t])) {
+          cur = f;
+        } else if (t >= 0) { /* the true label becomes the false one */
+          tail->head = new T::CjumpStm(
+              T::notRel(cjumpstm->op), cjumpstm->left, cjumpstm->right,
+              cjumpstm->false_label, cjumpstm->true_label);
+          cur = t;
+        } else {
+          TEMP::Label* falselabel = TEMP::NewLabel();
+          tail->head =
+              new T::CjumpStm(cjumpstm->op, cjumpstm->left, cjumpstm->right,
+                              cjumpstm->true_label, falselabel);
+          tail->tail = new T::StmList(
+              new T::LabelStm(falselabel),
+              new T::StmList(jump_to(cjumpstm->false_label), nullptr));
+          tail = tail->tail->tail;
+        }
+      } else
+        assert(0);
+    }
   }
-  assert(0); /* dst should be temp or mem only */
-}
-
-Stm* ExpStm::Canon(Stm* self) {
-  if (this->exp->kind == Exp::Kind::CALL)
-    return seq(reorder(get_call_rlist(this->exp)), self);
-  else
-    return seq(reorder(new C::ExpRefList(&this->exp, nullptr)), self);
-}
-
-C::StmAndExp BinopExp::Canon(Exp* self) {
-  return C::StmAndExp(
-      reorder(new C::ExpRefList(&this->left,
-                                new C::ExpRefList(&this->right, nullptr))),
-      self);
-}
-
-C::StmAndExp MemExp::Canon(Exp* self) {
-  return C::StmAndExp(reorder(new C::ExpRefList(&this->exp, nullptr)), self);
+  tail->tail = new T::StmList(new T::LabelStm(b.label), nullptr);
+  return head.tail;
 }
 
-C::StmAndExp TempExp::Canon(Exp* self) {
-  return C::StmAndExp(reorder(nullptr), self);
-}
-
-C::StmAndExp EseqExp::Canon(Exp* self) {
-  C::StmAndExp x = do_exp(this->exp);
-  return C::StmAndExp(seq(do_stm(this->stm), x.s), x.e);
-}
-
-C::StmAndExp NameExp::Canon(Exp* self) {
-  return C::StmAndExp(reorder(nullptr), self);
-}
-
-C::StmAndExp ConstExp::Canon(Exp* self) {
-  return C::StmAndExp(reorder(nullptr), self);
-}
-
-C::StmAndExp CallExp::Canon(Exp* self) {
-  return C::StmAndExp(reorder(get_call_rlist(self)), self);
-}
-
-}  // namespace T
\ No newline at end of file
+}  // namespace C
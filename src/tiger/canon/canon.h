@@ -2,6 +2,7 @@
 #define TIGER_CANON_CANON_H_
 
 #include <cstdio>
+#include <vector>
 
 #include "tiger/frame/temp.h"
 #include "tiger/translate/tree.h"
@@ -77,5 +78,12 @@ Block BasicBlocks(T::StmList* stmList);
 */
 T::StmList* TraceSchedule(Block b);
 
+/* The same, laid out by freq, the estimated frequency of each block of b
+   in list order. Traces start at the entry and then at the hottest block
+   not yet placed, and each one continues into its hottest successor, so
+   hot paths fall through and cold blocks end up last. Ties go to the
+   false label and to the original order, as above. */
+T::StmList* TraceSchedule(Block b, const std::vector<double>& freq);
+
 }  // namespace C
 #endif
\ No newline at end of file
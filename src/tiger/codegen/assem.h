@@ -8,11 +8,16 @@
 
 namespace AS {
 
+/* Where control may go after an instruction: the labels, and the next
+ * instruction unless fallthrough is false (a jmp, or a tail call with no
+ * labels at all) */
 class Targets {
  public:
   TEMP::LabelList* labels;
+  bool fallthrough;
 
-  Targets(TEMP::LabelList* labels) : labels(labels) {}
+  Targets(TEMP::LabelList* labels, bool fallthrough = true)
+      : labels(labels), fallthrough(fallthrough) {}
 };
 
 class Instr {
@@ -26,10 +26,11 @@ namespace {
   }
 
   void munchStm(T::Stm* s);
-  TEMP::TempList* munchArgs(T::ExpList* args);
+  TEMP::TempList* munchArgs(T::ExpList* args, bool tail);
   std::string toOpString(T::RelOp op);
   TEMP::Temp* munchExp(T::Exp* e);
   TEMP::TempList* L(TEMP::Temp* h, TEMP::TempList* t);
+  std::string memOperand(T::Exp* addr, TEMP::Temp** base, int index);
 
   AS::InstrList* naiveRegAlloc(F::Frame* f, AS::InstrList* iList);
   std::vector<AS::Instr *> toVector(AS::InstrList* iList);
@@ -83,8 +84,15 @@ namespace {
 
         if (dst->kind == T::Exp::MEM) {
           T::MemExp* dstMemExp = static_cast<T::MemExp *>(dst);
-          TEMP::Temp* dstTemp = munchExp(dstMemExp->exp);
-          emit(new AS::OperInstr("movq `s0, (`s1)", 
+          if (dstMemExp->exp->kind == T::Exp::NAME) {
+            std::string name = static_cast<T::NameExp *>(dstMemExp->exp)->name->Name();
+            emit(new AS::OperInstr("movq `s0, " + name + "(%rip)",
+                  nullptr, L(srcTemp, nullptr), new AS::Targets(nullptr)));
+            return;
+          }
+          TEMP::Temp* dstTemp;
+          std::string operand = memOperand(dstMemExp->exp, &dstTemp, 1);
+          emit(new AS::OperInstr("movq `s0, " + operand, 
                 nullptr,
                   new TEMP::TempList(srcTemp, new TEMP::TempList(dstTemp, nullptr)), new AS::Targets(nullptr)));
           return;
@@ -102,7 +110,7 @@ namespace {
       case T::Stm::Kind::JUMP: {
         T::JumpStm* jumpStm = static_cast<T::JumpStm *>(s);
         std::string labelString = "jmp " + jumpStm->exp->name->Name();
-        emit(new AS::OperInstr(labelString, nullptr, nullptr, new AS::Targets(jumpStm->jumps)));
+        emit(new AS::OperInstr(labelString, nullptr, nullptr, new AS::Targets(jumpStm->jumps, false)));
         return;
       }
       case T::Stm::Kind::CJUMP: {
@@ -174,8 +182,14 @@ namespace {
       }
       case T::Exp::Kind::MEM: {
         T::MemExp* memExp = static_cast<T::MemExp *>(e);
-        TEMP::Temp* addr = munchExp(memExp->exp);
-        emit(new AS::OperInstr("movq (`s0),`d0", L(r, nullptr), L(addr, nullptr), new AS::Targets(nullptr)));
+        if (memExp->exp->kind == T::Exp::Kind::NAME) {
+          std::string name = static_cast<T::NameExp *>(memExp->exp)->name->Name();
+          emit(new AS::OperInstr("movq " + name + "(%rip),`d0", L(r, nullptr), nullptr, new AS::Targets(nullptr)));
+          return r;
+        }
+        TEMP::Temp* addr;
+        std::string operand = memOperand(memExp->exp, &addr, 0);
+        emit(new AS::OperInstr("movq " + operand + ",`d0", L(r, nullptr), L(addr, nullptr), new AS::Targets(nullptr)));
         return r;
       }
       case T::Exp::Kind::TEMP: {
@@ -206,7 +220,12 @@ namespace {
       case T::Exp::Kind::CALL: {
         T::CallExp* callExp = static_cast<T::CallExp *>(e);
         T::NameExp* funcExp = static_cast<T::NameExp *>(callExp->fun);
-        TEMP::TempList* argsTemps = munchArgs(callExp->args);
+        TEMP::TempList* argsTemps = munchArgs(callExp->args, callExp->tail);
+        if (callExp->tail) {
+          // No jump targets: F_procEntryExit3 pops the frame right before it
+          emit(new AS::OperInstr("jmp " + funcExp->name->Name(), nullptr, argsTemps, new AS::Targets(nullptr, false)));
+          return F::RV();
+        }
         std::string instr = "call " + funcExp->name->Name() + "@PLT";
         emit(new AS::OperInstr(instr, F::notCalleesaves(), argsTemps, new AS::Targets(nullptr)));
         emit(new AS::MoveInstr("movq `s0, `d0", L(r, nullptr), L(F::RV(), nullptr)));
@@ -224,6 +243,25 @@ namespace {
     return new TEMP::TempList(h, t);
   }
 
+  // Folds a constant offset, and the frame pointer, into the addressing mode
+  std::string memOperand(T::Exp* addr, TEMP::Temp** base, int index) {
+    std::string reg = "(`s" + std::to_string(index) + ")";
+    int offset = 0;
+    if (addr->kind == T::Exp::Kind::BINOP) {
+      T::BinopExp* binopExp = static_cast<T::BinopExp *>(addr);
+      if (binopExp->op == T::BinOp::PLUS_OP && binopExp->right->kind == T::Exp::Kind::CONST) {
+        offset = static_cast<T::ConstExp *>(binopExp->right)->consti;
+        addr = binopExp->left;
+      }
+    }
+    if (addr->kind == T::Exp::Kind::TEMP && static_cast<T::TempExp *>(addr)->temp == F::FP()) {
+      *base = F::SP();
+      return "(" + fs + (offset < 0 ? "" : "+") + std::to_string(offset) + ")" + reg;
+    }
+    *base = munchExp(addr);
+    return (offset ? std::to_string(offset) : "") + reg;
+  }
+
   std::string toOpString(T::RelOp op) {
     std::string opString;
     switch (op) {
@@ -245,6 +283,18 @@ namespace {
       case T::RelOp::LT_OP:
         opString = "jl";
         break;
+      case T::RelOp::ULT_OP:
+        opString = "jb";
+        break;
+      case T::RelOp::ULE_OP:
+        opString = "jbe";
+        break;
+      case T::RelOp::UGT_OP:
+        opString = "ja";
+        break;
+      case T::RelOp::UGE_OP:
+        opString = "jae";
+        break;
       default:
         std::cerr << "T::RelOp not recognized: " << op << std::endl;
         assert(0);
@@ -252,7 +302,8 @@ namespace {
     return opString;
   }
 
-  TEMP::TempList* munchArgs(T::ExpList* args) {
+  // Stack arguments of a tail call overwrite the caller's own incoming ones
+  TEMP::TempList* munchArgs(T::ExpList* args, bool tail) {
     int count = 0;
     TEMP::TempList* argsregs = F::argregs();
     TEMP::TempList* result = nullptr;
@@ -264,6 +315,11 @@ namespace {
         result = new TEMP::TempList(argsregs->head, result);
         argsregs = argsregs->tail;
       }
+      else if (tail) {
+        std::string s = "movq `s0, (" + fs + "+" + std::to_string(offsetFromStackPointer + F::wordSize) + ")(%rsp)";
+        emit(new AS::OperInstr(s, nullptr, L(arg, nullptr), new AS::Targets(nullptr)));
+        offsetFromStackPointer += F::wordSize;
+      }
       else {
         std::string s = "movq `s0, " + std::to_string(offsetFromStackPointer) + "(%rsp)";
         emit(new AS::OperInstr(s, nullptr, L(arg, nullptr), new AS::Targets(nullptr)));
@@ -271,7 +327,7 @@ namespace {
       }
       count++;
     }
-    if (count > targetFrame->GetMaxArgNumber())
+    if (!tail && count > targetFrame->GetMaxArgNumber())
       targetFrame->SetMaxArgNumber(count);
     return result;
   }
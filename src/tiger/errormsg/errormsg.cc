@@ -32,6 +32,22 @@ void ErrorMsg::Error(int pos, std::string message, ...) {
   fprintf(stderr, "\n");
 }
 
+// Formats pos as "file:line.col", the prefix Error() puts on its messages
+std::string ErrorMsg::Position(int pos) {
+  IntList *lines = linePos;
+  int num = lineNum;
+
+  while (lines && lines->i >= pos) {
+    lines = lines->rest;
+    num--;
+  }
+
+  std::string position = fileName;
+  if (lines)
+    position += ":" + std::to_string(num) + "." + std::to_string(pos - lines->i);
+  return position;
+}
+
 void ErrorMsg::Reset(std::string fname, std::ifstream &infile) {
   anyErrors = false;
   fileName = fname;
@@ -17,6 +17,7 @@ class ErrorMsg {
 
   void Newline();
   void Error(int, std::string, ...);
+  std::string Position(int);
   void Reset(std::string, std::ifstream &);
 
   bool anyErrors = false;
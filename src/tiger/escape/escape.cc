@@ -2,12 +2,16 @@
 
 namespace ESC {
 
+// Also records which variables are ever assigned, loop variables have
+// nowhere to record it since they are read-only
 class EscapeEntry {
  public:
   int depth;
   bool* escape;
+  bool* assigned;
 
-  EscapeEntry(int depth, bool* escape) : depth(depth), escape(escape) {}
+  EscapeEntry(int depth, bool* escape, bool* assigned)
+      : depth(depth), escape(escape), assigned(assigned) {}
 };
 
 void FindEscape(A::Exp* exp) {
@@ -78,6 +82,11 @@ namespace A {
   }
 
   void AssignExp::Traverse(S::Table<ESC::EscapeEntry> *env, int depth) {
+    if (var->kind == Var::SIMPLE) {
+      ESC::EscapeEntry* e = env->Look(static_cast<SimpleVar *>(var)->sym);
+      if (e && e->assigned)
+        *(e->assigned) = true;
+    }
     var->Traverse(env, depth);
     exp->Traverse(env, depth);
   }
@@ -96,7 +105,7 @@ namespace A {
 
   void ForExp::Traverse(S::Table<ESC::EscapeEntry> *env, int depth) {
     escape = false;
-    ESC::EscapeEntry* e = new ESC::EscapeEntry(depth, &escape);
+    ESC::EscapeEntry* e = new ESC::EscapeEntry(depth, &escape, nullptr);
     env->BeginScope();
     env->Enter(var, e);
     lo->Traverse(env, depth);
@@ -134,7 +143,8 @@ namespace A {
       for (FieldList* field = funDec->params; field; field = field->tail) {
         Field* f = field->head;
         f->escape = false;
-        ESC::EscapeEntry* e = new ESC::EscapeEntry(depth+1, &f->escape);
+        f->assigned = false;
+        ESC::EscapeEntry* e = new ESC::EscapeEntry(depth+1, &f->escape, &f->assigned);
         env->Enter(f->name, e);
       }
       funDec->body->Traverse(env, depth+1);
@@ -144,8 +154,9 @@ namespace A {
 
   void VarDec::Traverse(S::Table<ESC::EscapeEntry> *env, int depth) {
     escape = false;
-    env->Enter(var, new ESC::EscapeEntry(depth, &escape));
-    init->Traverse(env, depth);
+    assigned = false;
+    init->Traverse(env, depth);  // in the scope outside the new variable
+    env->Enter(var, new ESC::EscapeEntry(depth, &escape, &assigned));
   }
 
   void TypeDec::Traverse(S::Table<ESC::EscapeEntry> *env, int depth) {
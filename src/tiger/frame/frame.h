@@ -2,6 +2,7 @@
 #define TIGER_FRAME_FRAME_H_
 
 #include <string>
+#include <vector>
 
 #include "tiger/codegen/assem.h"
 #include "tiger/translate/tree.h"
@@ -42,7 +43,7 @@ T::Exp* externalCall(std::string s, T::ExpList* args);
 
 T::Stm* F_procEntryExit1(Frame* frame, T::Stm* stm); // P172 P267-269 TODO
 AS::InstrList* F_procEntryExit2(AS::InstrList* body); // P215 TODO
-AS::Proc* F_procEntryExit3(Frame* frame, AS::InstrList* body); // P267-269 TODO
+AS::Proc* F_procEntryExit3(Frame* frame, AS::InstrList* body, TEMP::Map* coloring); // P267-269 TODO
 
 int defaultRegisterColor(TEMP::Temp* t);
 std::string* color2register(int color);
@@ -59,6 +60,7 @@ class Frame {
 
     Frame(Kind kind) : kind(kind) {}
     virtual TEMP::Label* GetName() const = 0;
+    virtual TEMP::Label* GetEntryLabel() const = 0; // Target of self tail calls
     virtual AccessList* GetFormalList() const = 0;
     virtual Access* AllocLocal(bool escape) = 0;
     virtual T::Stm* GetPrologue() const = 0;
@@ -93,7 +95,7 @@ class AccessList {
 
 class Frag {
  public:
-  enum Kind { STRING, PROC };
+  enum Kind { STRING, PROC, DATA };
 
   Kind kind;
 
@@ -109,6 +111,16 @@ class StringFrag : public Frag {
       : Frag(STRING), label(label), str(str) {}
 };
 
+// Read-only words, such as the record descriptors read by the collector
+class DataFrag : public Frag {
+ public:
+  TEMP::Label *label;
+  std::vector<long> words;
+
+  DataFrag(TEMP::Label *label, std::vector<long> words)
+      : Frag(DATA), label(label), words(words) {}
+};
+
 class ProcFrag : public Frag {
  public:
   T::Stm *body;
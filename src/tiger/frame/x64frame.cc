@@ -3,6 +3,9 @@
 #include <string>
 #include <vector>
 
+#include "tiger/opt/profile.h"
+#include "tiger/util/options.h"
+
 namespace {
   TEMP::Temp* rsp = nullptr;
   TEMP::Temp* rax = nullptr;
@@ -227,6 +230,7 @@ TEMP::TempList* allocatableRegisters() {
                               new TEMP::TempList(R14(),
                               new TEMP::TempList(R15(), nullptr)))))))))))))));
   }
+  return allocatableRegisterList;
 }
 
 TEMP::TempList* specialregs() {
@@ -440,9 +444,12 @@ class X64Frame : public Frame {
     int frameSize;
     T::Stm* prologue; // view shift, move parameters to other places
     int maxArgNumber;
+    TEMP::Label* entry; // after the prologue, self tail calls jump here
 
     X64Frame(TEMP::Label* name, U::BoolList* formals) : Frame(X64), name(name) {
+      entry = TEMP::NewLabel();
       formalList = nullptr;
+      prologue = nullptr;
       frameSize = 0;
       maxArgNumber = 0;
 
@@ -580,6 +587,7 @@ class X64Frame : public Frame {
                 new T::TempExp(inRegAccess->reg),
                 new T::MemExp(new T::BinopExp(T::PLUS_OP, new T::TempExp(FP()), new T::ConstExp((num - 5) * wordSize)))
               );
+              AddToPrologue(stm);
               break;
             }
           }
@@ -592,6 +600,10 @@ class X64Frame : public Frame {
       return name;
     }
 
+    TEMP::Label* GetEntryLabel() const override {
+      return entry;
+    }
+
     AccessList* GetFormalList() const override {
       return formalList;
     }
@@ -632,43 +644,15 @@ Frame* NewX64Frame(TEMP::Label* name, U::BoolList* formals) {
 }
 
 T::Stm* F_procEntryExit1(Frame* frame, T::Stm* stm) {
-  std::vector<TEMP::Temp *> calleeSaveTemps;
-  T::Stm* save = nullptr;
-  T::Stm* restore = nullptr;
-
-  // Save registers
-  TEMP::TempList* calleeSaveRegisters = calleesaves();
-  for (; calleeSaveRegisters; calleeSaveRegisters = calleeSaveRegisters->tail) {
-    TEMP::Temp* temp = TEMP::Temp::NewTemp();
-    T::Exp* tempExp = new T::TempExp(temp);
-    calleeSaveTemps.push_back(temp);
-    if (save) {
-      save = new T::SeqStm(save, new T::MoveStm(tempExp, new T::TempExp(calleeSaveRegisters->head)));
-    }
-    else {
-      save = new T::MoveStm(tempExp, new T::TempExp(calleeSaveRegisters->head));
-    }
-  }
-
-  // Restore registers
-  calleeSaveRegisters = calleesaves();
-  int count = 0;
-  for (; calleeSaveRegisters; calleeSaveRegisters = calleeSaveRegisters->tail) {
-    T::Exp* tempExp = new T::TempExp(calleeSaveTemps[count]);
-    if (restore) {
-      restore = new T::SeqStm(restore, new T::MoveStm(new T::TempExp(calleeSaveRegisters->head), tempExp));
-    }
-    else {
-      restore = new T::MoveStm(new T::TempExp(calleeSaveRegisters->head), tempExp);
-    }
-    count++;
-  }
-
+  // Callee-save registers are saved by F_procEntryExit3, and only those the
+  // register allocator actually hands out
   T::Stm* prologue = frame->GetPrologue();
   if (!prologue) {
     prologue = new T::ExpStm(new T::ConstExp(0));
   }
-  return new T::SeqStm(prologue, new T::SeqStm(save, new T::SeqStm(stm, restore)));
+  // Self tail calls rebind the formals and jump back to the entry label
+  T::Stm* entry = new T::LabelStm(frame->GetEntryLabel());
+  return new T::SeqStm(prologue, new T::SeqStm(entry, stm));
 }
 
 AS::InstrList* F_procEntryExit2(AS::InstrList* body) {
@@ -677,23 +661,84 @@ AS::InstrList* F_procEntryExit2(AS::InstrList* body) {
   if (!returnSink)
     returnSink = 
     new TEMP::TempList(SP(), 
-      new TEMP::TempList(RV(), 
-        calleesaves()));
+      new TEMP::TempList(RV(), nullptr));
   return AS::InstrList::Splice(body, 
           new AS::InstrList(new AS::OperInstr("", nullptr, returnSink, nullptr), nullptr));
 }
 
-AS::Proc* F_procEntryExit3(Frame* frame, AS::InstrList* body) {
+AS::Proc* F_procEntryExit3(Frame* frame, AS::InstrList* body, TEMP::Map* coloring) {
+  // Callee-save registers written by the body get a slot of their own
+  std::vector<std::pair<std::string, int> > saved;
+  for (TEMP::TempList* regs = calleesaves(); regs; regs = regs->tail) {
+    std::string name = *tempMap()->Look(regs->head);
+    bool written = false;
+    for (AS::InstrList* head = body; head && !written; head = head->tail)
+      for (TEMP::TempList* def = head->head->GetDef(); def && !written; def = def->tail) {
+        std::string* reg = coloring->Look(def->head);
+        written = reg && *reg == name;
+      }
+    if (written) {
+      frame->AllocLocal(true);
+      saved.push_back(std::make_pair(name, frame->GetSize()));
+    }
+  }
+
   int extraArgs = 0;
   if (frame->GetMaxArgNumber() > 6)
     extraArgs = frame->GetMaxArgNumber() - 6;
+  int size = frame->GetSize() + wordSize * extraArgs;
+  // Calls need %rsp 16-byte aligned, the return address takes 8 bytes
+  if ((size + wordSize) % 16)
+    size += wordSize;
   std::string fs = frame->GetName()->Name() + "_framesize";
-  std::string prolog = ".set " + fs + "," + std::to_string(frame->GetSize() + wordSize * extraArgs) + "\n";
+
+  std::string prolog = ".set " + fs + "," + std::to_string(size) + "\n";
   prolog = prolog + frame->GetName()->Name() + ":\n";
-  prolog = prolog + "subq $" + std::to_string(frame->GetSize() + wordSize * extraArgs) + ",%rsp\n";
-  std::string epilog = "addq $" + std::to_string(frame->GetSize() + wordSize * extraArgs) + ",%rsp\n";
+  if (U::options().profile)
+    prolog = prolog + OPT::CountInstr(frame->GetName()->Name()) + "\n";
+  prolog = prolog + "subq $" + std::to_string(size) + ",%rsp\n";
+  std::vector<std::string> exit;
+  for (const std::pair<std::string, int>& slot : saved) {
+    std::string address = std::to_string(size - slot.second) + "(%rsp)";
+    prolog = prolog + "movq " + slot.first + "," + address + "\n";
+    exit.push_back("movq " + address + "," + slot.first);
+  }
+  exit.push_back("addq $" + std::to_string(size) + ",%rsp");
+
+  // A tail call leaves through "jmp callee" without jump targets or a
+  // fallthrough, so it needs the same restores and pop as the ret below
+  for (AS::InstrList* head = body; head; head = head->tail) {
+    if (head->head->kind != AS::Instr::Kind::OPER)
+      continue;
+    AS::OperInstr* operInstr = static_cast<AS::OperInstr *>(head->head);
+    if (!operInstr->jumps || operInstr->jumps->fallthrough || operInstr->jumps->labels)
+      continue;
+    for (const std::string& instr : exit) {
+      head->tail = new AS::InstrList(head->head, head->tail);
+      head->head = new AS::OperInstr(instr, nullptr, nullptr, new AS::Targets(nullptr));
+      head = head->tail;
+    }
+  }
+
+  // Block counters go right after the labels of the scheduled blocks,
+  // where no condition codes are live
+  if (U::options().profileBlocks) {
+    for (AS::InstrList* head = body; head; head = head->tail) {
+      if (head->head->kind != AS::Instr::Kind::LABEL)
+        continue;
+      const std::string& block = OPT::BlockName(static_cast<AS::LabelInstr *>(head->head)->label);
+      if (block.empty())
+        continue;
+      head->tail = new AS::InstrList(new AS::OperInstr(OPT::CountInstr(block), nullptr, nullptr, nullptr), head->tail);
+      head = head->tail;
+    }
+  }
+
+  std::string epilog;
+  for (const std::string& instr : exit)
+    epilog = epilog + instr + "\n";
   epilog = epilog + "ret\n";
   return new AS::Proc(prolog, body, epilog);
 }
 
-}  // namespace F
\ No newline at end of file
+}  // namespace F
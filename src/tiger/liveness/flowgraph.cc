@@ -1,83 +1,194 @@
 #include "tiger/liveness/flowgraph.h"
 #include <vector>
-#include <map>
+#include <unordered_map>
+#include <utility>
 #include <iostream>
 
 namespace {
-  std::vector<AS::Instr *> toVector(AS::InstrList* iList);
+  int intersect(const std::vector<int>& idom, const std::vector<int>& rpoNumber, int a, int b);
 }
 
 namespace FG {
 
-TEMP::TempList* Def(G::Node<AS::Instr>* n) {
-  return n->NodeInfo()->GetDef();
+TEMP::TempList* Def(FlowGraph* g, int n) {
+  return g->NodeInfo(n)->GetDef();
 }
 
-TEMP::TempList* Use(G::Node<AS::Instr>* n) {
-  return n->NodeInfo()->GetUse();
+TEMP::TempList* Use(FlowGraph* g, int n) {
+  return g->NodeInfo(n)->GetUse();
 }
 
-bool IsMove(G::Node<AS::Instr>* n) {
-  return n->NodeInfo()->kind == AS::Instr::Kind::MOVE;
+bool IsMove(FlowGraph* g, int n) {
+  return g->NodeInfo(n)->kind == AS::Instr::Kind::MOVE;
 }
 
-G::Graph<AS::Instr>* AssemFlowGraph(AS::InstrList* il, F::Frame* f) {
-  G::Graph<AS::Instr>* graph = new G::Graph<AS::Instr>();
-  std::vector<AS::Instr *> instrList = toVector(il);
-  std::vector<G::Node<AS::Instr>*> nodes;
-  std::map<TEMP::Label*, G::Node<AS::Instr>*> label2node;
-
-  std::size_t s = instrList.size();
-  if (s == 0)
-    return graph;
-  
-  // Create nodes and handle labels
-  for (std::size_t i = 0; i < s; ++i) {
-    G::Node<AS::Instr>* curNode = graph->NewNode(instrList[i]);
-    nodes.push_back(curNode);
-    if (instrList[i]->kind == AS::Instr::Kind::LABEL) {
-      TEMP::Label* l = static_cast<AS::LabelInstr*>(instrList[i])->label;
-      label2node[l] = curNode;
+FlowGraph* AssemFlowGraph(AS::InstrList* il, F::Frame* f) {
+  FlowGraph* graph = new FlowGraph();
+  BlockCFG& blocks = graph->blocks;
+
+  // Labels are numbered as they are first mentioned, defined or jumped to;
+  // jumps to labels further down wait in pending until the end
+  std::unordered_map<TEMP::Label*, int> labelIndex;
+  std::vector<int> labelNode; // -1 until the label is defined
+  std::vector<std::pair<int, int> > pending;
+
+  bool endsBlock = true; // The previous instruction was a jump
+  bool fallsThrough = false; // Control can reach this one from the previous
+  int i = 0;
+  for (; il; il = il->tail, ++i) {
+    AS::Instr* instr = il->head;
+    assert(instr);
+    graph->NewNode(instr);
+    if (fallsThrough)
+      graph->AddEdge(i - 1, i);
+    if (endsBlock || instr->kind == AS::Instr::Kind::LABEL) {
+      blocks.first.push_back(i);
+      blocks.graph.NewNode(instr);
+    }
+    blocks.blockOf.push_back(blocks.first.size() - 1);
+    endsBlock = false;
+    fallsThrough = true;
+
+    if (instr->kind == AS::Instr::Kind::LABEL) {
+      TEMP::Label* l = static_cast<AS::LabelInstr*>(instr)->label;
+      std::pair<std::unordered_map<TEMP::Label*, int>::iterator, bool> entry =
+          labelIndex.insert(std::make_pair(l, (int)labelNode.size()));
+      if (entry.second)
+        labelNode.push_back(i);
+      else
+        labelNode[entry.first->second] = i;
+    }
+    else if (instr->kind == AS::Instr::Kind::OPER) {
+      AS::Targets* jumps = static_cast<AS::OperInstr*>(instr)->jumps;
+      if (!jumps || (jumps->fallthrough && !jumps->labels))
+        continue;
+      endsBlock = true;
+      fallsThrough = jumps->fallthrough;
+      for (TEMP::LabelList* head = jumps->labels; head; head = head->tail) {
+        std::pair<std::unordered_map<TEMP::Label*, int>::iterator, bool> entry =
+            labelIndex.insert(std::make_pair(head->head, (int)labelNode.size()));
+        if (entry.second)
+          labelNode.push_back(-1);
+        int target = labelNode[entry.first->second];
+        if (target >= 0)
+          graph->AddEdge(i, target);
+        else
+          pending.push_back(std::make_pair(i, entry.first->second));
+      }
     }
   }
 
-  // Add edges between adjacent instructions
-  for (std::size_t i = 0; i < s-1; ++i) {
-    std::string assem = instrList[i]->GetAssem();
-    if (assem[0] == 'j' && assem[1] == 'm' && assem[2] == 'p')
+  for (const std::pair<int, int>& jump : pending) {
+    int target = labelNode[jump.second];
+    if (target < 0) {
+      AS::OperInstr* operInstr = static_cast<AS::OperInstr*>(graph->NodeInfo(jump.first));
+      std::cerr << "Unknown label in AssemFlowGraph: " << operInstr->assem << std::endl;
+      assert(0);
+    }
+    graph->AddEdge(jump.first, target);
+  }
+  graph->Freeze();
+
+  // Blocks end in their last instruction; one without successors leaves
+  int n = i;
+  if (blocks.first.empty()) {
+    blocks.first.push_back(0);
+    blocks.graph.NewNode(nullptr);
+  }
+  int exit = blocks.graph.NewNode(nullptr);
+  blocks.first.push_back(n);
+  blocks.first.push_back(n);
+  for (int b = 0; b < exit; ++b) {
+    int last = blocks.first[b + 1] - 1;
+    if (last < blocks.first[b] || graph->Succ(last).empty()) {
+      blocks.graph.AddEdge(b, exit);
       continue;
-    graph->AddEdge(nodes[i], nodes[i+1]);
+    }
+    for (int succ : graph->Succ(last))
+      blocks.graph.AddEdge(b, blocks.blockOf[succ]);
   }
+  blocks.graph.Freeze();
+  blocks.Order();
+  return graph;
+}
 
-  // Add edges for jump instructions
-  for (std::size_t i = 0; i < s; ++i) {
-    if (instrList[i]->kind == AS::Instr::Kind::OPER) {
-      AS::OperInstr* operInstr = static_cast<AS::OperInstr*>(instrList[i]);
-      if (operInstr->jumps) {
-        for (TEMP::LabelList* head = operInstr->jumps->labels; head; head = head->tail) {
-          if (label2node.find(head->head) == label2node.end()) {
-            std::cerr << "Unknown label in AssemFlowGraph: " << head->head->Name() << std::endl;
-            assert(0);
-          }
-          else {
-            graph->AddEdge(nodes[i], label2node[head->head]);
-          }
-        }
+void BlockCFG::Order() {
+  int n = BlockCount();
+
+  // Reverse postorder with an explicit stack, entry first
+  rpo.clear();
+  rpoNumber.assign(n, -1);
+  std::vector<bool> visited(n, false);
+  std::vector<std::pair<int, int> > stack;
+  std::vector<int> postorder;
+  stack.push_back(std::make_pair(Entry(), 0));
+  visited[Entry()] = true;
+  while (!stack.empty()) {
+    int b = stack.back().first;
+    int i = stack.back().second;
+    G::FlatGraph<AS::Instr>::Range succs = graph.Succ(b);
+    if (i < succs.size()) {
+      stack.back().second++;
+      int s = succs.begin()[i];
+      if (!visited[s]) {
+        visited[s] = true;
+        stack.push_back(std::make_pair(s, 0));
       }
     }
+    else {
+      postorder.push_back(b);
+      stack.pop_back();
+    }
   }
-  return graph;
+  for (int i = postorder.size() - 1; i >= 0; i--) {
+    rpoNumber[postorder[i]] = rpo.size();
+    rpo.push_back(postorder[i]);
+  }
+
+  // Cooper, Harvey and Kennedy's iterative dominator algorithm
+  idom.assign(n, -1);
+  idom[Entry()] = Entry();
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (int b : rpo) {
+      if (b == Entry())
+        continue;
+      int newIdom = -1;
+      for (int p : graph.Pred(b)) {
+        if (idom[p] < 0)
+          continue;
+        newIdom = newIdom < 0 ? p : intersect(idom, rpoNumber, p, newIdom);
+      }
+      if (newIdom != idom[b]) {
+        idom[b] = newIdom;
+        changed = true;
+      }
+    }
+  }
+  idom[Entry()] = -1;
+}
+
+bool BlockCFG::Dominates(int a, int b) const {
+  if (!Reachable(a) || !Reachable(b))
+    return false;
+  for (; b >= 0; b = idom[b]) {
+    if (b == a)
+      return true;
+  }
+  return false;
 }
 
 }  // namespace FG
 
 namespace {
-  std::vector<AS::Instr *> toVector(AS::InstrList* iList) {
-    std::vector<AS::Instr *> result;
-    for (AS::InstrList* head = iList; head; head = head->tail) {
-      assert(head->head);
-      result.push_back(head->head);
+  int intersect(const std::vector<int>& idom, const std::vector<int>& rpoNumber, int a, int b) {
+    while (a != b) {
+      while (rpoNumber[a] > rpoNumber[b])
+        a = idom[a];
+      while (rpoNumber[b] > rpoNumber[a])
+        b = idom[b];
     }
-    return result;
+    return a;
   }
 }
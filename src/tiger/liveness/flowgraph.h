@@ -1,20 +1,52 @@
 #ifndef TIGER_LIVENESS_FLOWGRAPH_H_
 #define TIGER_LIVENESS_FLOWGRAPH_H_
 
+#include <vector>
+
 #include "tiger/codegen/assem.h"
 #include "tiger/frame/frame.h"
 #include "tiger/frame/temp.h"
-#include "tiger/util/graph.h"
+#include "tiger/util/flatgraph.h"
 
 namespace FG {
 
-TEMP::TempList* Def(G::Node<AS::Instr>* n);
-TEMP::TempList* Use(G::Node<AS::Instr>* n);
+/* The basic blocks of a flow graph. Block b holds the instructions
+ * first[b] .. first[b+1]-1. Block 0 is the entry; the last block is an
+ * empty exit that every block leaving the function goes to, whether by
+ * falling off the end or through a tail call. */
+class BlockCFG {
+ public:
+  G::FlatGraph<AS::Instr> graph;  // node b's info is its first instruction
+  std::vector<int> first;
+  std::vector<int> blockOf;  // the block of each instruction
+  std::vector<int> idom;     // -1 for the entry and for unreachable blocks
+  std::vector<int> rpo;      // reachable blocks in reverse postorder
+  std::vector<int> rpoNumber;  // -1 for unreachable blocks
+
+  int BlockCount() const { return graph.NodeCount(); }
+  int Entry() const { return 0; }
+  int Exit() const { return graph.NodeCount() - 1; }
+
+  bool Reachable(int b) const { return rpoNumber[b] >= 0; }
+  bool Dominates(int a, int b) const;
+
+  /* Fill in rpo, rpoNumber and idom once the graph is frozen */
+  void Order();
+};
+
+/* Node i is the i-th instruction of the list the graph was built from */
+class FlowGraph : public G::FlatGraph<AS::Instr> {
+ public:
+  BlockCFG blocks;
+};
+
+TEMP::TempList* Def(FlowGraph* g, int n);
+TEMP::TempList* Use(FlowGraph* g, int n);
 
-bool IsMove(G::Node<AS::Instr>* n);
+bool IsMove(FlowGraph* g, int n);
 
-G::Graph<AS::Instr>* AssemFlowGraph(AS::InstrList* il, F::Frame* f);
+FlowGraph* AssemFlowGraph(AS::InstrList* il, F::Frame* f);
 
 }  // namespace FG
 
-#endif
\ No newline at end of file
+#endif
@@ -1,178 +1,157 @@
 #include "tiger/liveness/liveness.h"
-#include <map>
+#include <algorithm>
+#include <iterator>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace {
 
-  bool inTempList(TEMP::TempList* l, TEMP::Temp* t);
-  bool equalTempList(TEMP::TempList* l1, TEMP::TempList* l2);
-  TEMP::TempList* unionTempList(TEMP::TempList* l1, TEMP::TempList* l2);
-  TEMP::TempList* minusTempList(TEMP::TempList* l1, TEMP::TempList* l2);
+  typedef LIVE::TempSet TempSet;
+
+  class TempIndex {
+   public:
+    explicit TempIndex(std::vector<TEMP::Temp*>* temps) : temps(temps) {}
+    int Lookup(TEMP::Temp* t);
+    TempSet Lookup(TEMP::TempList* l);
+
+   private:
+    std::vector<TEMP::Temp*>* temps;
+    std::unordered_map<TEMP::Temp*, int> index;
+  };
+
+  TempSet unionTempSet(const TempSet& s1, const TempSet& s2);
+  TempSet minusTempSet(const TempSet& s1, const TempSet& s2);
 
 }
 
 namespace LIVE {
 
-LiveGraph Liveness(G::Graph<AS::Instr>* flowgraph) {
-
-  LiveGraph result;
+LiveSets Solve(FG::FlowGraph* flowgraph) {
 
-  std::map<G::Node<AS::Instr>*, TEMP::TempList*> node2in;
-  std::map<G::Node<AS::Instr>*, TEMP::TempList*> node2out;
+  LiveSets result;
+  int n = flowgraph->NodeCount();
 
-  // Record all the nodes in map
-  for (G::NodeList<AS::Instr>* head = flowgraph->Nodes(); head; head = head->tail) {
-    G::Node<AS::Instr>* node = head->head;
-    assert(node);
-    node2in[node] = nullptr;
-    node2out[node] = nullptr;
+  TempIndex temps(&result.temps);
+  for (TEMP::TempList* head = F::allocatableRegisters(); head; head = head->tail) {
+    assert(head->head);
+    temps.Lookup(head->head);
+  }
+  result.registerCount = result.temps.size();
+
+  std::vector<TempSet>& use = result.use;
+  std::vector<TempSet>& def = result.def;
+  use.resize(n);
+  def.resize(n);
+  for (int i = 0; i < n; ++i) {
+    def[i] = temps.Lookup(flowgraph->NodeInfo(i)->GetDef());
+    use[i] = temps.Lookup(flowgraph->NodeInfo(i)->GetUse());
   }
 
-  // Compute liveness by iteration P221 10.4
-  bool ok = false;
-  while (!ok) {
-    ok = true;
-    for (G::NodeList<AS::Instr>* head = flowgraph->Nodes(); head; head = head->tail) {
-      G::Node<AS::Instr>* node = head->head;
-      assert(node);
-      TEMP::TempList* in_old = node2in[node];
-      TEMP::TempList* out_old = node2out[node];
-      node2in[node] = unionTempList(node->NodeInfo()->GetUse(), 
-                                    minusTempList(node2out[node], node->NodeInfo()->GetDef()));
-      TEMP::TempList* union_succ_in = nullptr;
-      for (G::NodeList<AS::Instr>* succ = node->Succ(); succ; succ = succ->tail) {
-        assert(succ->head);
-        TEMP::TempList* in_succ = node2in[succ->head];
-        union_succ_in = unionTempList(union_succ_in, in_succ);
+  // Compute liveness P221 10.4 with a worklist, starting from the last
+  // instruction; a node is revisited only when a successor's in changed
+  std::vector<TempSet>& in = result.in;
+  std::vector<TempSet>& out = result.out;
+  in.resize(n);
+  out.resize(n);
+  std::vector<int> worklist;
+  std::vector<bool> queued(n, true);
+  for (int i = 0; i < n; ++i)
+    worklist.push_back(i);
+  while (!worklist.empty()) {
+    int node = worklist.back();
+    worklist.pop_back();
+    queued[node] = false;
+    TempSet union_succ_in;
+    for (int succ : flowgraph->Succ(node))
+      union_succ_in = unionTempSet(union_succ_in, in[succ]);
+    out[node].swap(union_succ_in);
+    TempSet new_in = unionTempSet(use[node], minusTempSet(out[node], def[node]));
+    if (new_in != in[node]) {
+      in[node].swap(new_in);
+      for (int pred : flowgraph->Pred(node)) {
+        if (!queued[pred]) {
+          queued[pred] = true;
+          worklist.push_back(pred);
+        }
       }
-      node2out[node] = union_succ_in;
-      if (!equalTempList(node2in[node], in_old) || !equalTempList(node2out[node], out_old))
-        ok = false;
     }
   }
+  return result;
+}
 
-  // Construct interference graph
-  result.graph = new G::Graph<TEMP::Temp>();
-  result.moves = nullptr;
-  std::map<TEMP::Temp*, G::Node<TEMP::Temp>*> temp2node;
+LiveGraph Liveness(FG::FlowGraph* flowgraph) {
 
-  // Add machine registers into the interference graph
-  for (TEMP::TempList* head = F::allocatableRegisters(); head; head = head->tail) {
-    assert(head->head);
-    G::Node<TEMP::Temp>* node = result.graph->NewNode(head->head);
-    assert(node);
-    temp2node[head->head] = node;
-  }
+  LiveGraph result;
+  LiveSets sets = Solve(flowgraph);
+  int n = flowgraph->NodeCount();
+  const std::vector<TempSet>& use = sets.use;
+  const std::vector<TempSet>& def = sets.def;
+  const std::vector<TempSet>& out = sets.out;
+  int registerCount = sets.registerCount;
+
+  // Interference graph over the dense temp numbers, machine registers first
+  G::FlatGraph<TEMP::Temp> interference;
+  for (TEMP::Temp* temp : sets.temps)
+    interference.NewNode(temp);
 
   // All the machine registers interfere with each other
-  for (TEMP::TempList* r1 = F::allocatableRegisters(); r1; r1 = r1->tail) {
-    for (TEMP::TempList* r2 = r1->tail; r2; r2 = r2->tail) {
-      G::Node<TEMP::Temp>* node1 = temp2node[r1->head];
-      G::Node<TEMP::Temp>* node2 = temp2node[r2->head];
-      result.graph->AddEdge(node1, node2);
-      result.graph->AddEdge(node2, node1);
-    }
-  }
-
-  // Add temporary registers into the graph
-  for (G::NodeList<AS::Instr>* head = flowgraph->Nodes(); head; head = head->tail) {
-    G::Node<AS::Instr>* node = head->head;
-    TEMP::TempList* allTemps = unionTempList(node2in[node], 
-                               unionTempList(node2out[node],
-                               unionTempList(node->NodeInfo()->GetDef(),
-                               node->NodeInfo()->GetUse())));
-    for (TEMP::TempList* head = allTemps; head; head = head->tail) {
-      assert(head->head);
-      if (head->head == F::SP()) // %rsp is not allocatable
-        continue;
-      if (temp2node.find(head->head) == temp2node.end()) {
-        G::Node<TEMP::Temp>* node = result.graph->NewNode(head->head);
-        temp2node[head->head] = node;
-      }
+  for (int r1 = 0; r1 < registerCount; ++r1) {
+    for (int r2 = 0; r2 < registerCount; ++r2) {
+      if (r1 != r2)
+        interference.AddEdge(r1, r2);
     }
   }
 
   // Add edges between temporary registers P229
-  for (G::NodeList<AS::Instr>* head = flowgraph->Nodes(); head; head = head->tail) {
-    G::Node<AS::Instr>* node = head->head;
-    assert(node);
-    TEMP::TempList* def = node->NodeInfo()->GetDef();
-    if (!def)
-      continue;
-
-    if (!FG::IsMove(node)) {
-
-      /*
-       * P229 Rule 1
-       * Non-move instructions => Add edges between def and out
-       */
-
-      for (TEMP::TempList* defHead = def; defHead; defHead = defHead->tail) {
-        assert(defHead->head);
-        TEMP::Temp* defTemp = defHead->head;
-        if (defTemp == F::SP())
+  std::vector<std::pair<int, int> > moves;
+  std::set<std::pair<int, int> > seenMoves;
+  for (int node = 0; node < n; ++node) {
+    bool isMove = FG::IsMove(flowgraph, node);
+    for (int defTemp : def[node]) {
+      for (int outTemp : out[node]) {
+
+        /*
+         * P229 Rule 1
+         * Non-move instructions => Add edges between def and out
+         * Rule 2
+         * Move instructions => Add edges between def and (out - use)
+         */
+
+        if (outTemp == defTemp)
           continue;
-        G::Node<TEMP::Temp>* defNode = temp2node[defTemp];
-        assert(defNode);
-        TEMP::TempList* outTemps = node2out[node];
-        for (TEMP::TempList* outTempsHead = outTemps; outTempsHead; outTempsHead = outTempsHead->tail) {
-          assert(outTempsHead->head);
-          TEMP::Temp* outTemp = outTempsHead->head;
-          if (outTemp == F::SP())
-            continue;
-          G::Node<TEMP::Temp>* outNode = temp2node[outTemp];
-          if (defNode != outNode) {
-            if (!outNode->Adj() || !outNode->Adj()->InNodeList(defNode)) {
-              result.graph->AddEdge(defNode, outNode);
-              result.graph->AddEdge(outNode, defNode);
-            }
-          }
-        }
-      }
-    }
-    else {
-
-      /*
-       * P229 Rule 2
-       * Move instructions => Add edges between def and (out - use)
-       */
-
-      for (TEMP::TempList* defHead = def; defHead; defHead = defHead->tail) {
-        assert(defHead->head);
-        TEMP::Temp* defTemp = defHead->head;
-        if (defTemp == F::SP())
+        if (isMove && std::binary_search(use[node].begin(), use[node].end(), outTemp))
           continue;
-        G::Node<TEMP::Temp>* defNode = temp2node[defTemp];
-        assert(defNode);
-        TEMP::TempList* outTemps = node2out[node];
-        for (TEMP::TempList* outTempsHead = outTemps; outTempsHead; outTempsHead = outTempsHead->tail) {
-          assert(outTempsHead->head);
-          TEMP::Temp* outTemp = outTempsHead->head;
-          if (outTemp == F::SP())
-            continue;
-          G::Node<TEMP::Temp>* outNode = temp2node[outTemp];
-          assert(outNode);
-          if (outNode != defNode) {
-            if (!(outNode->Adj() && outNode->Adj()->InNodeList(defNode)) && !inTempList(node->NodeInfo()->GetUse(), outTemp)) {
-              result.graph->AddEdge(defNode, outNode);
-              result.graph->AddEdge(outNode, defNode);
-            }
-          }
-        }
+        interference.AddEdge(defTemp, outTemp);
+        interference.AddEdge(outTemp, defTemp);
+      }
 
-        // Add to movelist
-        for (TEMP::TempList* uses = node->NodeInfo()->GetUse(); uses; uses = uses->tail) {
-          assert(uses->head);
-          if (uses->head == F::SP())
-            continue;
-          G::Node<TEMP::Temp>* useNode = temp2node[uses->head];
-          assert(useNode);
-          if (!result.moves || !result.moves->InMoveList(useNode, defNode)) {
-            result.moves = new MoveList(useNode, defNode, result.moves);
-          }
+      // Add to movelist
+      if (isMove) {
+        for (int useTemp : use[node]) {
+          if (seenMoves.insert(std::make_pair(useTemp, defTemp)).second)
+            moves.push_back(std::make_pair(useTemp, defTemp));
         }
       }
     }
   }
+  interference.Freeze();
+
+  // The allocator rewrites the graph as it coalesces, so it gets a copy in
+  // the linked representation
+  result.graph = new G::Graph<TEMP::Temp>();
+  std::vector<G::Node<TEMP::Temp>*> nodes;
+  for (int t = 0; t < interference.NodeCount(); ++t)
+    nodes.push_back(result.graph->NewNode(interference.NodeInfo(t)));
+  for (int t = 0; t < interference.NodeCount(); ++t) {
+    for (int adj : interference.Succ(t))
+      G::Graph<TEMP::Temp>::AddNewEdge(nodes[t], nodes[adj]);
+  }
+
+  result.moves = nullptr;
+  for (const std::pair<int, int>& move : moves)
+    result.moves = new MoveList(nodes[move.first], nodes[move.second], result.moves);
   return result;
 }
 
@@ -180,49 +159,43 @@ LiveGraph Liveness(G::Graph<AS::Instr>* flowgraph) {
 
 namespace {
 
-  bool inTempList(TEMP::TempList* l, TEMP::Temp* t) {
+  // %rsp is not allocatable and never enters the live sets
+  int TempIndex::Lookup(TEMP::Temp* t) {
     assert(t);
-    for (TEMP::TempList* head = l; head; head = head->tail) {
-      if (head->head == t)
-        return true;
-    }
-    return false;
+    if (t == F::SP())
+      return -1;
+    std::unordered_map<TEMP::Temp*, int>::iterator it = index.find(t);
+    if (it != index.end())
+      return it->second;
+    int i = temps->size();
+    temps->push_back(t);
+    index[t] = i;
+    return i;
   }
 
-  bool equalTempList(TEMP::TempList* l1, TEMP::TempList* l2) {
-    for (TEMP::TempList* head1 = l1; head1; head1 = head1->tail) {
-      assert(head1->head);
-      if (!inTempList(l2, head1->head))
-        return false;
-    }
-    for (TEMP::TempList* head2 = l2; head2; head2 = head2->tail) {
-      assert(head2->head);
-      if (!inTempList(l1, head2->head))
-        return false;
+  TempSet TempIndex::Lookup(TEMP::TempList* l) {
+    TempSet result;
+    for (; l; l = l->tail) {
+      int i = Lookup(l->head);
+      if (i >= 0)
+        result.push_back(i);
     }
-    return true;
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
   }
 
-  TEMP::TempList* unionTempList(TEMP::TempList* l1, TEMP::TempList* l2) {
-    TEMP::TempList* result = l1;
-    for (TEMP::TempList* head2 = l2; head2; head2 = head2->tail) {
-      assert(head2->head);
-      if (!inTempList(result, head2->head)) {
-        result = new TEMP::TempList(head2->head, result);
-      }
-    }
+  TempSet unionTempSet(const TempSet& s1, const TempSet& s2) {
+    TempSet result;
+    result.reserve(s1.size() + s2.size());
+    std::set_union(s1.begin(), s1.end(), s2.begin(), s2.end(), std::back_inserter(result));
     return result;
   }
 
-  TEMP::TempList* minusTempList(TEMP::TempList* l1, TEMP::TempList* l2) {
-    TEMP::TempList* result = nullptr;
-    for (TEMP::TempList* head1 = l1; head1; head1 = head1->tail) {
-      assert(head1->head);
-      if (!inTempList(l2, head1->head))
-        result = new TEMP::TempList(head1->head, result);
-    }
+  TempSet minusTempSet(const TempSet& s1, const TempSet& s2) {
+    TempSet result;
+    std::set_difference(s1.begin(), s1.end(), s2.begin(), s2.end(), std::back_inserter(result));
     return result;
   }
 
 }
-
@@ -1,6 +1,8 @@
 #ifndef TIGER_LIVENESS_LIVENESS_H_
 #define TIGER_LIVENESS_LIVENESS_H_
 
+#include <vector>
+
 #include "tiger/codegen/assem.h"
 #include "tiger/frame/frame.h"
 #include "tiger/frame/temp.h"
@@ -33,7 +35,21 @@ class LiveGraph {
   MoveList* moves;
 };
 
-LiveGraph Liveness(G::Graph<AS::Instr>* flowgraph);
+/* Sorted dense numbers of temps */
+typedef std::vector<int> TempSet;
+
+/* The dataflow solution for each node of a flow graph. Temps are numbered
+ * with the allocatable machine registers first; %rsp is left out. */
+class LiveSets {
+ public:
+  std::vector<TEMP::Temp*> temps;  // by number
+  int registerCount;
+  std::vector<TempSet> def, use, in, out;
+};
+
+LiveSets Solve(FG::FlowGraph* flowgraph);
+
+LiveGraph Liveness(FG::FlowGraph* flowgraph);
 
 inline bool inMoveList(G::Node<TEMP::Temp>* src, G::Node<TEMP::Temp>* dst, MoveList* list) {
   assert(src && dst);
@@ -0,0 +1,135 @@
+#include "tiger/liveness/loopnest.h"
+#include <algorithm>
+#include <map>
+#include <utility>
+
+namespace {
+  std::map<F::Frame*, FG::Analysis*> analyses;
+}
+
+namespace FG {
+
+LoopNest::LoopNest(const BlockCFG& blocks) {
+  int n = blocks.BlockCount();
+  const G::FlatGraph<AS::Instr>& graph = blocks.graph;
+
+  // Dominator tree, numbered in pre- and postorder so that a dominates b
+  // exactly when b's interval lies inside a's
+  children.assign(n, std::vector<int>());
+  for (int b : blocks.rpo) {
+    if (blocks.idom[b] >= 0)
+      children[blocks.idom[b]].push_back(b);
+  }
+  pre.assign(n, -1);
+  post.assign(n, -1);
+  int preCount = 0, postCount = 0;
+  std::vector<std::pair<int, int> > stack;
+  if (n > 0 && blocks.Reachable(blocks.Entry())) {
+    stack.push_back(std::make_pair(blocks.Entry(), 0));
+    pre[blocks.Entry()] = preCount++;
+  }
+  while (!stack.empty()) {
+    int b = stack.back().first;
+    int i = stack.back().second;
+    if (i < (int)children[b].size()) {
+      stack.back().second++;
+      int c = children[b][i];
+      pre[c] = preCount++;
+      stack.push_back(std::make_pair(c, 0));
+    }
+    else {
+      post[b] = postCount++;
+      stack.pop_back();
+    }
+  }
+
+  // Cooper, Harvey and Kennedy: walk up from each predecessor of a join
+  // point until its immediate dominator
+  frontier.assign(n, std::vector<int>());
+  for (int b : blocks.rpo) {
+    int reachablePreds = 0;
+    for (int p : graph.Pred(b)) {
+      if (blocks.Reachable(p))
+        reachablePreds++;
+    }
+    if (reachablePreds < 2)
+      continue;
+    for (int p : graph.Pred(b)) {
+      if (!blocks.Reachable(p))
+        continue;
+      for (int runner = p; runner != blocks.idom[b]; runner = blocks.idom[runner]) {
+        if (!frontier[runner].empty() && frontier[runner].back() == b)
+          break;
+        frontier[runner].push_back(b);
+      }
+    }
+  }
+
+  // A back edge goes to a block that dominates its source. Headers come
+  // in reverse postorder, so loops outside come before the loops inside
+  // them and each loop's parent is already known when it is filled in.
+  loopOf.assign(n, -1);
+  std::vector<int> mark(n, -1);
+  std::vector<int> work;
+  for (int h : blocks.rpo) {
+    work.clear();
+    for (int p : graph.Pred(h)) {
+      if (Dominates(h, p))
+        work.push_back(p);
+    }
+    if (work.empty())
+      continue;
+    int loop = header.size();
+    header.push_back(h);
+    parent.push_back(loopOf[h]);
+    depth.push_back(loopOf[h] < 0 ? 1 : depth[loopOf[h]] + 1);
+    body.push_back(std::vector<int>(1, h));
+    mark[h] = loop;
+    while (!work.empty()) {
+      int b = work.back();
+      work.pop_back();
+      if (mark[b] == loop)
+        continue;
+      mark[b] = loop;
+      body[loop].push_back(b);
+      for (int p : graph.Pred(b)) {
+        if (blocks.Reachable(p) && mark[p] != loop)
+          work.push_back(p);
+      }
+    }
+    for (int b : body[loop])
+      loopOf[b] = loop;
+  }
+}
+
+bool LoopNest::Dominates(int a, int b) const {
+  if (pre[a] < 0 || pre[b] < 0)
+    return false;
+  return pre[a] <= pre[b] && post[b] <= post[a];
+}
+
+Analysis* Analyze(F::Frame* f, const std::vector<AS::Instr*>& instrs) {
+  std::map<F::Frame*, Analysis*>::iterator it = analyses.find(f);
+  if (it != analyses.end())
+    return it->second;
+  AS::InstrList* il = nullptr;
+  for (std::size_t i = instrs.size(); i-- > 0;)
+    il = new AS::InstrList(instrs[i], il);
+  Analysis* analysis = new Analysis();
+  analysis->flowGraph = AssemFlowGraph(il, f);
+  analysis->loops = new LoopNest(analysis->flowGraph->blocks);
+  analyses[f] = analysis;
+  return analysis;
+}
+
+void Invalidate(F::Frame* f) {
+  std::map<F::Frame*, Analysis*>::iterator it = analyses.find(f);
+  if (it == analyses.end())
+    return;
+  delete it->second->flowGraph;
+  delete it->second->loops;
+  delete it->second;
+  analyses.erase(it);
+}
+
+}  // namespace FG
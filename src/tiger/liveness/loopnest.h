@@ -0,0 +1,69 @@
+#ifndef TIGER_LIVENESS_LOOPNEST_H_
+#define TIGER_LIVENESS_LOOPNEST_H_
+
+#include <vector>
+
+#include "tiger/frame/frame.h"
+#include "tiger/liveness/flowgraph.h"
+
+namespace FG {
+
+/* Dominator tree, dominance frontiers and natural loops of the blocks of
+ * a flow graph. Unreachable blocks are in no tree and no loop. */
+class LoopNest {
+ public:
+  explicit LoopNest(const BlockCFG& blocks);
+
+  /* Children of block b in the dominator tree */
+  const std::vector<int>& Children(int b) const { return children[b]; }
+
+  /* Does a dominate b; constant time */
+  bool Dominates(int a, int b) const;
+
+  /* Blocks where b's dominance ends */
+  const std::vector<int>& Frontier(int b) const { return frontier[b]; }
+
+  /* Loops are numbered so that every loop comes after the loops around
+   * it; back edges to the same header make up one loop */
+  int LoopCount() const { return header.size(); }
+  int Header(int loop) const { return header[loop]; }
+  int Parent(int loop) const { return parent[loop]; }  // -1 at the top
+  const std::vector<int>& Body(int loop) const { return body[loop]; }
+
+  /* The innermost loop around block b, or -1 */
+  int LoopOf(int b) const { return loopOf[b]; }
+
+  /* How many loops are around block b */
+  int Depth(int b) const { return loopOf[b] < 0 ? 0 : depth[loopOf[b]]; }
+
+ private:
+  std::vector<std::vector<int> > children;
+  std::vector<int> pre, post;  // numbers in the dominator tree, -1 if unreachable
+  std::vector<std::vector<int> > frontier;
+
+  std::vector<int> header;
+  std::vector<int> parent;
+  std::vector<int> depth;
+  std::vector<std::vector<int> > body;
+  std::vector<int> loopOf;
+};
+
+/* The flow graph and loop nest of one function */
+class Analysis {
+ public:
+  FlowGraph* flowGraph;
+  LoopNest* loops;
+
+  /* Loop depth of the i-th instruction */
+  int Depth(int i) const { return loops->Depth(flowGraph->blocks.blockOf[i]); }
+};
+
+/* The analysis of instrs, the instructions of f. It is built on the first
+ * call and handed out again until Invalidate(f), which whoever edits the
+ * instructions must call; only then is an instruction list made. */
+Analysis* Analyze(F::Frame* f, const std::vector<AS::Instr*>& instrs);
+void Invalidate(F::Frame* f);
+
+}  // namespace FG
+
+#endif
@@ -1,4 +1,5 @@
 #include <cstdio>
+#include <cstdlib>
 #include <fstream>
 #include <string>
 
@@ -9,9 +10,17 @@
 #include "tiger/errormsg/errormsg.h"
 #include "tiger/escape/escape.h"
 #include "tiger/frame/frame.h"
+#include "tiger/opt/copyprop.h"
+#include "tiger/opt/layout.h"
+#include "tiger/opt/loop.h"
+#include "tiger/opt/profile.h"
+#include "tiger/opt/schedule.h"
+#include "tiger/opt/valnum.h"
 #include "tiger/parse/parser.h"
 #include "tiger/regalloc/regalloc.h"
+#include "tiger/translate/translate.h"
 #include "tiger/translate/tree.h"
+#include "tiger/util/options.h"
 
 extern EM::ErrorMsg errormsg;
 
@@ -35,17 +44,28 @@ void do_proc(FILE* out, F::ProcFrag* procFrag) {
   //  stmList->Print(stdout);
   //  printf("-------====Linearlized=====-----\n");  /* 8 */
   struct C::Block blo = C::BasicBlocks(stmList);
+  blo = OPT::OptimizeLoops(blo);
+  if (U::options().valueNumbering)
+    blo = OPT::NumberValues(blo);
+  OPT::NameBlocks(procFrag->frame->GetName(), blo);
   //  C::StmListList* stmLists = blo.stmLists;
   //  for (; stmLists; stmLists = stmLists->tail) {
   //  	stmLists->head->Print(stdout);
   // 	printf("------====Basic block=====-------\n");
   //  }
-  stmList = C::TraceSchedule(blo);
+  if (U::options().blockLayout)
+    stmList = C::TraceSchedule(blo, OPT::BlockFrequencies(blo));
+  else
+    stmList = C::TraceSchedule(blo);
   //  stmList->Print(stdout);
   //  printf("-------====trace=====-----\n");
 
   // lab5&lab6: code generation
   AS::InstrList* iList = CG::Codegen(procFrag->frame, stmList); /* 9 */
+  if (U::options().copyPropagation)
+    iList = OPT::PropagateCopies(iList, procFrag->frame);
+  if (U::options().schedule)
+    iList = OPT::ScheduleBlocks(iList);
   //  AS_printInstrList(stdout, iList, Temp::Map::LayerMap(temp_map,
   //  Temp_name()));
 
@@ -54,8 +74,7 @@ void do_proc(FILE* out, F::ProcFrag* procFrag) {
   RA::Result allocation = RA::RegAlloc(procFrag->frame, iList); /* 11 */
   //  printf("----======after RA=======-----\n");
 
-  // AS::Proc* proc = F::F_procEntryExit3(procFrag->frame, allocation.il);
-  AS::Proc* proc = F::F_procEntryExit3(procFrag->frame, allocation.il);
+  AS::Proc* proc = F::F_procEntryExit3(procFrag->frame, allocation.il, allocation.coloring);
 
   std::string procName = procFrag->frame->GetName()->Name();
   fprintf(out, ".globl %s\n", procName.c_str());
@@ -70,12 +89,20 @@ void do_proc(FILE* out, F::ProcFrag* procFrag) {
   fprintf(out, ".size %s, .-%s\n", procName.c_str(), procName.c_str());
 }
 
+// FNV-1a, the runtime computes the same hash for strings built at run time
+unsigned int string_hash(const std::string& str) {
+  unsigned int hash = 2166136261u;
+  for (unsigned char c : str) hash = (hash ^ c) * 16777619u;
+  return hash ? hash : 1;
+}
+
 void do_str(FILE* out, F::StringFrag* strFrag) {
   fprintf(out, "%s:\n", strFrag->label->Name().c_str());
   int length = strFrag->str.size();
   // it may contains zeros in the middle of string. To keep this work, we need
   // to print all the charactors instead of using fprintf(str)
   fprintf(out, ".long %d\n", length);
+  fprintf(out, ".long %u\n", string_hash(strFrag->str));
   fprintf(out, ".string \"");
   for (int i = 0; i < length; i++) {
     if (strFrag->str[i] == '\n') {
@@ -91,18 +118,82 @@ void do_str(FILE* out, F::StringFrag* strFrag) {
   fprintf(out, "\"\n");
 }
 
+void do_data(FILE* out, F::DataFrag* dataFrag) {
+  fprintf(out, ".align 8\n");
+  fprintf(out, "%s:\n", dataFrag->label->Name().c_str());
+  for (long word : dataFrag->words) fprintf(out, ".quad %ld\n", word);
+}
+
+void usage() {
+  fprintf(stderr,
+          "usage: tiger-compiler [options] file.tig\n"
+          "  --inline-budget=N  inline functions of at most N IR nodes "
+          "(0 disables)\n"
+          "  --inline-report    report every inlined call on stderr\n"
+          "  --bounds-check     check array subscripts at run time\n"
+          "  --alloc-profile    number allocation sites for the profiling "
+          "runtime\n"
+          "  --profile          count function entries at run time\n"
+          "  --profile-blocks   count basic block entries as well\n"
+          "  --profile-use=FILE lay out blocks and spill by a profile\n"
+          "  --no-block-layout  keep the blocks in their original order\n"
+          "  --no-gvn           do not reuse values computed earlier\n"
+          "  --no-copy-prop     leave moves between temps to the allocator\n"
+          "  --no-schedule      do not reorder instructions within blocks\n"
+          "  --cache-links      keep outer frame pointers in temps\n");
+  exit(1);
+}
+
+// Returns the source file name after applying every option to U::options()
+const char* parse_args(int argc, char** argv) {
+  const char* fileName = nullptr;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--inline-report")
+      U::options().inlineReport = true;
+    else if (arg == "--bounds-check")
+      U::options().boundsCheck = true;
+    else if (arg == "--alloc-profile")
+      U::options().allocProfile = true;
+    else if (arg == "--no-block-layout")
+      U::options().blockLayout = false;
+    else if (arg == "--no-gvn")
+      U::options().valueNumbering = false;
+    else if (arg == "--no-copy-prop")
+      U::options().copyPropagation = false;
+    else if (arg == "--no-schedule")
+      U::options().schedule = false;
+    else if (arg == "--cache-links")
+      U::options().cachedLinks = true;
+    else if (arg == "--profile")
+      U::options().profile = true;
+    else if (arg == "--profile-blocks")
+      U::options().profile = U::options().profileBlocks = true;
+    else if (arg.compare(0, 14, "--profile-use=") == 0) {
+      if (!OPT::ReadProfile(arg.substr(14))) {
+        fprintf(stderr, "%s: cannot read profile\n", arg.c_str() + 14);
+        exit(1);
+      }
+    }
+    else if (arg.compare(0, 16, "--inline-budget=") == 0)
+      U::options().inlineBudget = atoi(arg.c_str() + 16);
+    else if (arg[0] == '-' || fileName)
+      usage();
+    else
+      fileName = argv[i];
+  }
+  if (!fileName) usage();
+  return fileName;
+}
+
 }  // namespace
 
 int main(int argc, char** argv) {
   F::FragList* frags = nullptr;
-  char outfile[100];
   FILE* out = stdout;
-  if (argc < 2) {
-    fprintf(stderr, "usage: tiger-compiler file.tig\n");
-    exit(1);
-  }
+  const char* fileName = parse_args(argc, argv);
 
-  errormsg.Reset(argv[1], infile);
+  errormsg.Reset(fileName, infile);
   Parser parser(infile, std::cerr);
   parser.parse();
 
@@ -117,8 +208,8 @@ int main(int argc, char** argv) {
   if (errormsg.anyErrors) return 1; /* don't continue */
 
   /* convert the filename */
-  sprintf(outfile, "%s.s", argv[1]);
-  out = fopen(outfile, "w");
+  std::string outfile = std::string(fileName) + ".s";
+  out = fopen(outfile.c_str(), "w");
 
   fprintf(out, ".text\n");
   for (F::FragList* fragList = frags; fragList; fragList = fragList->tail)
@@ -130,8 +221,54 @@ int main(int argc, char** argv) {
   for (F::FragList* fragList = frags; fragList; fragList = fragList->tail)
     if (fragList->head->kind == F::Frag::Kind::STRING) {
       do_str(out, static_cast<F::StringFrag*>(fragList->head));
+    } else if (fragList->head->kind == F::Frag::Kind::DATA) {
+      do_data(out, static_cast<F::DataFrag*>(fragList->head));
     }
 
+  // Every literal, for the runtime's intern table
+  fprintf(out, ".section .data.rel.ro\n");
+  fprintf(out, ".align 8\n");
+  fprintf(out, ".globl tiger_literals\n");
+  fprintf(out, "tiger_literals:\n");
+  for (F::FragList* fragList = frags; fragList; fragList = fragList->tail)
+    if (fragList->head->kind == F::Frag::Kind::STRING)
+      fprintf(out, ".quad %s\n",
+              static_cast<F::StringFrag*>(fragList->head)->label->Name().c_str());
+  fprintf(out, ".quad 0\n");
+
+  // Site names for a runtime built with -DTIGER_ALLOC_PROFILE
+  if (U::options().allocProfile) {
+    const std::vector<std::string>& sites = TR::AllocSites();
+    fprintf(out, ".globl tiger_alloc_sites\n");
+    fprintf(out, "tiger_alloc_sites:\n");
+    for (std::size_t i = 0; i < sites.size(); i++)
+      fprintf(out, ".quad .Lsite%zu\n", i);
+    fprintf(out, ".quad 0\n");
+    fprintf(out, ".section .rodata\n");
+    for (std::size_t i = 0; i < sites.size(); i++)
+      fprintf(out, ".Lsite%zu:\n.string \"%s\"\n", i, sites[i].c_str());
+  }
+
+  // Counters of --profile, dumped by the runtime at exit
+  if (U::options().profile) {
+    const std::vector<std::string>& counters = OPT::ProfileCounters();
+    fprintf(out, ".section .data.rel.ro\n");
+    fprintf(out, ".align 8\n");
+    fprintf(out, ".globl tiger_profile_names\n");
+    fprintf(out, "tiger_profile_names:\n");
+    for (std::size_t i = 0; i < counters.size(); i++)
+      fprintf(out, ".quad .Lcounter%zu\n", i);
+    fprintf(out, ".quad 0\n");
+    fprintf(out, ".section .rodata\n");
+    for (std::size_t i = 0; i < counters.size(); i++)
+      fprintf(out, ".Lcounter%zu:\n.string \"%s\"\n", i, counters[i].c_str());
+    fprintf(out, ".bss\n");
+    fprintf(out, ".align 8\n");
+    fprintf(out, ".globl tiger_profile_counts\n");
+    fprintf(out, "tiger_profile_counts:\n");
+    fprintf(out, ".zero %zu\n", 8 * (counters.size() + 1));
+  }
+
   fclose(out);
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,210 @@
+#include "tiger/opt/blockgraph.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace {
+
+int intersect(const std::vector<int>& idom, const std::vector<int>& rpoNumber,
+              int a, int b) {
+  while (a != b) {
+    while (rpoNumber[a] > rpoNumber[b]) a = idom[a];
+    while (rpoNumber[b] > rpoNumber[a]) b = idom[b];
+  }
+  return a;
+}
+
+}  // namespace
+
+namespace OPT {
+
+std::vector<TEMP::Label*> JumpTargets(T::Stm* stm) {
+  std::vector<TEMP::Label*> targets;
+  if (stm->kind == T::Stm::Kind::JUMP) {
+    T::JumpStm* jumpStm = static_cast<T::JumpStm*>(stm);
+    for (TEMP::LabelList* l = jumpStm->jumps; l; l = l->tail)
+      targets.push_back(l->head);
+  } else if (stm->kind == T::Stm::Kind::CJUMP) {
+    T::CjumpStm* cjumpStm = static_cast<T::CjumpStm*>(stm);
+    targets.push_back(cjumpStm->true_label);
+    targets.push_back(cjumpStm->false_label);
+  } else {
+    assert(0);
+  }
+  return targets;
+}
+
+T::Stm* RetargetJump(T::Stm* stm, TEMP::Label* from, TEMP::Label* to) {
+  if (stm->kind == T::Stm::Kind::JUMP) {
+    T::JumpStm* jumpStm = static_cast<T::JumpStm*>(stm);
+    TEMP::LabelList* jumps = nullptr;
+    TEMP::LabelList* tail = nullptr;
+    for (TEMP::LabelList* l = jumpStm->jumps; l; l = l->tail) {
+      TEMP::LabelList* cell =
+          new TEMP::LabelList(l->head == from ? to : l->head, nullptr);
+      if (tail)
+        tail->tail = cell;
+      else
+        jumps = cell;
+      tail = cell;
+    }
+    T::NameExp* exp = jumpStm->exp;
+    if (exp->name == from) exp = new T::NameExp(to);
+    return new T::JumpStm(exp, jumps);
+  }
+  assert(stm->kind == T::Stm::Kind::CJUMP);
+  T::CjumpStm* cjumpStm = static_cast<T::CjumpStm*>(stm);
+  return new T::CjumpStm(
+      cjumpStm->op, cjumpStm->left, cjumpStm->right,
+      cjumpStm->true_label == from ? to : cjumpStm->true_label,
+      cjumpStm->false_label == from ? to : cjumpStm->false_label);
+}
+
+BlockGraph::BlockGraph(C::Block block) : exitLabel(block.label) {
+  for (C::StmListList* l = block.stmLists; l; l = l->tail)
+    blocks.push_back(l->head);
+  Build();
+}
+
+void BlockGraph::Build() {
+  int n = blocks.size();
+  labelIndex.clear();
+  for (int b = 0; b < n; b++) labelIndex[LabelOf(b)] = b;
+
+  succs.assign(n, std::vector<int>());
+  preds.assign(n, std::vector<int>());
+  for (int b = 0; b < n; b++) {
+    for (TEMP::Label* target : JumpTargets(LastCell(b)->head)) {
+      int s = Lookup(target);
+      if (s < 0) continue;
+      bool seen = false;
+      for (int old : succs[b]) seen = seen || old == s;
+      if (seen) continue;
+      succs[b].push_back(s);
+      preds[s].push_back(b);
+    }
+  }
+
+  // Reverse postorder with an explicit stack, entry first
+  rpo.clear();
+  rpoNumber.assign(n, -1);
+  if (n == 0) {
+    idom.clear();
+    return;
+  }
+  std::vector<bool> visited(n, false);
+  std::vector<std::pair<int, int>> stack;
+  std::vector<int> postorder;
+  stack.push_back(std::make_pair(0, 0));
+  visited[0] = true;
+  while (!stack.empty()) {
+    int b = stack.back().first;
+    int i = stack.back().second;
+    if (i < (int)succs[b].size()) {
+      stack.back().second++;
+      int s = succs[b][i];
+      if (!visited[s]) {
+        visited[s] = true;
+        stack.push_back(std::make_pair(s, 0));
+      }
+    } else {
+      postorder.push_back(b);
+      stack.pop_back();
+    }
+  }
+  for (int i = postorder.size() - 1; i >= 0; i--) {
+    rpoNumber[postorder[i]] = rpo.size();
+    rpo.push_back(postorder[i]);
+  }
+
+  // Cooper, Harvey and Kennedy's iterative dominator algorithm
+  idom.assign(n, -1);
+  idom[0] = 0;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (int b : rpo) {
+      if (b == 0) continue;
+      int newIdom = -1;
+      for (int p : preds[b]) {
+        if (idom[p] < 0) continue;
+        newIdom = newIdom < 0 ? p : intersect(idom, rpoNumber, p, newIdom);
+      }
+      if (newIdom != idom[b]) {
+        idom[b] = newIdom;
+        changed = true;
+      }
+    }
+  }
+  idom[0] = -1;
+}
+
+C::Block BlockGraph::ToBlock() const {
+  C::Block block;
+  block.label = exitLabel;
+  block.stmLists = nullptr;
+  for (int b = blocks.size() - 1; b >= 0; b--)
+    block.stmLists = new C::StmListList(blocks[b], block.stmLists);
+  return block;
+}
+
+int BlockGraph::Lookup(TEMP::Label* label) const {
+  auto it = labelIndex.find(label);
+  return it == labelIndex.end() ? -1 : it->second;
+}
+
+TEMP::Label* BlockGraph::LabelOf(int b) const {
+  assert(blocks[b]->head->kind == T::Stm::Kind::LABEL);
+  return static_cast<T::LabelStm*>(blocks[b]->head)->label;
+}
+
+T::StmList* BlockGraph::LastCell(int b) const {
+  T::StmList* last = blocks[b];
+  while (last->tail) last = last->tail;
+  return last;
+}
+
+bool BlockGraph::Reachable(int b) const { return rpoNumber[b] >= 0; }
+
+bool BlockGraph::Dominates(int a, int b) const {
+  if (!Reachable(a) || !Reachable(b)) return false;
+  for (; b >= 0; b = idom[b])
+    if (b == a) return true;
+  return false;
+}
+
+std::vector<NaturalLoop> NaturalLoops(const BlockGraph& graph) {
+  int n = graph.blocks.size();
+  std::map<int, NaturalLoop> byHeader;
+  for (int latch : graph.rpo) {
+    for (int header : graph.succs[latch]) {
+      if (!graph.Dominates(header, latch)) continue;
+      NaturalLoop& loop = byHeader[header];
+      if (loop.header < 0) {
+        loop.header = header;
+        loop.contains.assign(n, false);
+        loop.contains[header] = true;
+        loop.body.push_back(header);
+      }
+      std::vector<int> worklist(1, latch);
+      while (!worklist.empty()) {
+        int b = worklist.back();
+        worklist.pop_back();
+        if (loop.contains[b] || !graph.Reachable(b)) continue;
+        loop.contains[b] = true;
+        loop.body.push_back(b);
+        for (int p : graph.preds[b]) worklist.push_back(p);
+      }
+    }
+  }
+
+  std::vector<NaturalLoop> loops;
+  for (auto& entry : byHeader) loops.push_back(entry.second);
+  std::stable_sort(loops.begin(), loops.end(),
+                   [](const NaturalLoop& a, const NaturalLoop& b) {
+                     return a.body.size() < b.body.size();
+                   });
+  return loops;
+}
+
+}  // namespace OPT
@@ -0,0 +1,65 @@
+#ifndef TIGER_OPT_BLOCKGRAPH_H_
+#define TIGER_OPT_BLOCKGRAPH_H_
+
+#include <map>
+#include <vector>
+
+#include "tiger/canon/canon.h"
+#include "tiger/frame/temp.h"
+#include "tiger/translate/tree.h"
+
+namespace OPT {
+
+/* Control flow graph over the basic blocks produced by C::BasicBlocks.
+ * Node i is blocks[i] and block 0 is the entry. Every block begins with a
+ * LABEL and ends with a JUMP or CJUMP, so the edges are exactly the jump
+ * targets that name another block; the exit label names none. */
+class BlockGraph {
+ public:
+  std::vector<T::StmList*> blocks;
+  std::vector<std::vector<int>> succs;
+  std::vector<std::vector<int>> preds;
+  std::vector<int> idom;  // -1 for the entry and for unreachable blocks
+  std::vector<int> rpo;   // reachable blocks in reverse postorder
+  TEMP::Label* exitLabel;
+
+  explicit BlockGraph(C::Block block);
+
+  /* Recompute edges and dominators after blocks were added or retargeted */
+  void Build();
+  C::Block ToBlock() const;
+
+  int Lookup(TEMP::Label* label) const;
+  TEMP::Label* LabelOf(int b) const;
+  T::StmList* LastCell(int b) const;
+  bool Reachable(int b) const;
+  bool Dominates(int a, int b) const;
+
+ private:
+  std::map<TEMP::Label*, int> labelIndex;
+  std::vector<int> rpoNumber;  // -1 for unreachable blocks
+};
+
+/* A natural loop: the header and every reachable block that gets to one
+ * of the back edges into it without passing the header. Loops sharing a
+ * header are one loop. */
+class NaturalLoop {
+ public:
+  int header = -1;
+  std::vector<int> body;       // header first
+  std::vector<bool> contains;  // indexed by block
+};
+
+/* The natural loops of graph, smallest first, so every loop comes after
+ * the loops nested in it */
+std::vector<NaturalLoop> NaturalLoops(const BlockGraph& graph);
+
+/* Jump targets of the JUMP or CJUMP ending a block */
+std::vector<TEMP::Label*> JumpTargets(T::Stm* stm);
+
+/* Copy of a JUMP or CJUMP with every occurrence of `from` replaced by `to` */
+T::Stm* RetargetJump(T::Stm* stm, TEMP::Label* from, TEMP::Label* to);
+
+}  // namespace OPT
+
+#endif  // TIGER_OPT_BLOCKGRAPH_H_
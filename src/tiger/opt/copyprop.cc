@@ -0,0 +1,208 @@
+#include "tiger/opt/copyprop.h"
+
+#include <unordered_set>
+#include <vector>
+
+#include "tiger/liveness/flowgraph.h"
+#include "tiger/liveness/liveness.h"
+
+namespace {
+
+// How far a move is followed up or down its block
+const int WINDOW = 64;
+
+// Deleting moves can make others dead in the blocks before; a few rounds
+// get nearly all of them
+const int MAX_ROUNDS = 4;
+
+std::unordered_set<TEMP::Temp*> machineRegisters;
+
+bool IsVirtual(TEMP::Temp* t) {
+  return machineRegisters.count(t) == 0;
+}
+
+bool Mentions(TEMP::TempList* l, TEMP::Temp* t) {
+  return TEMP::inTempList(t, l);
+}
+
+bool Defines(AS::Instr* instr, TEMP::Temp* t) {
+  return Mentions(instr->GetDef(), t);
+}
+
+bool Uses(AS::Instr* instr, TEMP::Temp* t) {
+  return Mentions(instr->GetUse(), t);
+}
+
+/* The list with from replaced by to; lists may be shared between
+ * instructions, so it is copied */
+TEMP::TempList* Replace(TEMP::TempList* l, TEMP::Temp* from, TEMP::Temp* to) {
+  if (!l)
+    return nullptr;
+  return new TEMP::TempList(l->head == from ? to : l->head, Replace(l->tail, from, to));
+}
+
+void ReplaceUse(AS::Instr* instr, TEMP::Temp* from, TEMP::Temp* to) {
+  if (instr->kind == AS::Instr::Kind::MOVE) {
+    AS::MoveInstr* move = static_cast<AS::MoveInstr*>(instr);
+    move->src = Replace(move->src, from, to);
+  } else {
+    AS::OperInstr* oper = static_cast<AS::OperInstr*>(instr);
+    oper->src = Replace(oper->src, from, to);
+  }
+}
+
+void ReplaceDef(AS::Instr* instr, TEMP::Temp* from, TEMP::Temp* to) {
+  if (instr->kind == AS::Instr::Kind::MOVE) {
+    AS::MoveInstr* move = static_cast<AS::MoveInstr*>(instr);
+    move->dst = Replace(move->dst, from, to);
+  } else {
+    AS::OperInstr* oper = static_cast<AS::OperInstr*>(instr);
+    oper->dst = Replace(oper->dst, from, to);
+  }
+}
+
+/* For the move at block[m], from s to t, where s is dead after it: if the
+ * value of s was computed earlier in the block and t is not touched since,
+ * compute it into t instead */
+bool RenameSource(std::vector<AS::Instr*>& block, int m, TEMP::Temp* s, TEMP::Temp* t) {
+  std::vector<int> window;
+  for (int j = m - 1; j >= 0 && m - j <= WINDOW; --j) {
+    AS::Instr* instr = block[j];
+    if (!instr)
+      continue;
+    if (Defines(instr, t) || Uses(instr, t))
+      return false;
+    bool def = Defines(instr, s);
+    bool use = Uses(instr, s);
+    if (def || use)
+      window.push_back(j);
+    if (!def || use)
+      continue;
+    // Where the value of s starts
+    for (int k : window) {
+      ReplaceDef(block[k], s, t);
+      ReplaceUse(block[k], s, t);
+    }
+    return true;
+  }
+  return false;
+}
+
+/* For the move at block[m], from s to t: if every use of its value of t
+ * is further down the block and s still holds the same value there, read
+ * s instead. liveOut is what is live at the end of the block. */
+bool ForwardSource(std::vector<AS::Instr*>& block, int m, TEMP::Temp* s, TEMP::Temp* t,
+                   const std::unordered_set<TEMP::Temp*>& liveOut) {
+  std::vector<int> uses;
+  bool sHolds = true;
+  bool ended = false;
+  int n = block.size();
+  for (int j = m + 1; j < n && !ended; ++j) {
+    AS::Instr* instr = block[j];
+    if (!instr)
+      continue;
+    if (j - m > WINDOW)
+      return false;
+    if (Uses(instr, t)) {
+      // A use tied to a def of t in a two-address instruction cannot change
+      if (!sHolds || Defines(instr, t))
+        return false;
+      uses.push_back(j);
+    }
+    if (Defines(instr, t))
+      ended = true;
+    else if (Defines(instr, s))
+      sHolds = false;
+  }
+  if (!ended && liveOut.count(t))
+    return false;
+  for (int j : uses)
+    ReplaceUse(block[j], t, s);
+  return true;
+}
+
+/* One backward pass over a block, deleting moves; liveOut is what is live
+ * at its end. Returns whether anything changed. */
+bool SweepBlock(std::vector<AS::Instr*>& block, const std::unordered_set<TEMP::Temp*>& liveOut) {
+  bool changed = false;
+  std::unordered_set<TEMP::Temp*> live = liveOut;
+  for (int i = block.size() - 1; i >= 0; --i) {
+    AS::Instr* instr = block[i];
+    if (instr->kind == AS::Instr::Kind::MOVE) {
+      AS::MoveInstr* move = static_cast<AS::MoveInstr*>(instr);
+      TEMP::Temp* t = move->dst->head;
+      TEMP::Temp* s = move->src->head;
+      bool deleted = false;
+      if (IsVirtual(t)) {
+        if (s == t || !live.count(t))
+          deleted = true;
+        else if (IsVirtual(s) && !live.count(s) && RenameSource(block, i, s, t))
+          deleted = true;
+        else if (IsVirtual(s) && ForwardSource(block, i, s, t, liveOut)) {
+          // The uses of t below read s now
+          live.erase(t);
+          live.insert(s);
+          deleted = true;
+        }
+      }
+      if (deleted) {
+        block[i] = nullptr;
+        changed = true;
+        continue;
+      }
+    }
+    for (TEMP::TempList* def = instr->GetDef(); def; def = def->tail)
+      live.erase(def->head);
+    for (TEMP::TempList* use = instr->GetUse(); use; use = use->tail)
+      live.insert(use->head);
+  }
+  return changed;
+}
+
+}  // namespace
+
+namespace OPT {
+
+AS::InstrList* PropagateCopies(AS::InstrList* il, F::Frame* f) {
+  if (machineRegisters.empty()) {
+    for (TEMP::TempList* reg = F::registers(); reg; reg = reg->tail)
+      machineRegisters.insert(reg->head);
+  }
+
+  for (int round = 0; round < MAX_ROUNDS; ++round) {
+    FG::FlowGraph* flowGraph = FG::AssemFlowGraph(il, f);
+    LIVE::LiveSets sets = LIVE::Solve(flowGraph);
+    const FG::BlockCFG& blocks = flowGraph->blocks;
+
+    bool changed = false;
+    std::vector<AS::Instr*> result;
+    for (int b = 0; b < blocks.Exit(); ++b) {
+      int first = blocks.first[b];
+      int end = blocks.first[b + 1];
+      if (first == end)
+        continue;
+      std::vector<AS::Instr*> block;
+      for (int i = first; i < end; ++i)
+        block.push_back(flowGraph->NodeInfo(i));
+      std::unordered_set<TEMP::Temp*> liveOut;
+      for (int t : sets.out[end - 1])
+        liveOut.insert(sets.temps[t]);
+      if (SweepBlock(block, liveOut))
+        changed = true;
+      for (AS::Instr* instr : block) {
+        if (instr)
+          result.push_back(instr);
+      }
+    }
+    delete flowGraph;
+
+    il = nullptr;
+    for (std::size_t i = result.size(); i-- > 0;)
+      il = new AS::InstrList(result[i], il);
+    if (!changed)
+      break;
+  }
+  return il;
+}
+
+}  // namespace OPT
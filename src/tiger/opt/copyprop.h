@@ -0,0 +1,22 @@
+#ifndef TIGER_OPT_COPYPROP_H_
+#define TIGER_OPT_COPYPROP_H_
+
+#include "tiger/codegen/assem.h"
+#include "tiger/frame/frame.h"
+
+namespace OPT {
+
+/* Removes register moves between temps before register allocation, so
+ * the allocator starts from fewer nodes and fewer moves to coalesce. A
+ * move goes away when its destination is dead, when its source was
+ * computed earlier in the block only to be copied (the computation then
+ * writes the destination itself), or when every use of its destination
+ * in the block can read the source instead. Moves to and from machine
+ * registers are kept, except dead ones. Works block by block from the
+ * live sets of the flow graph, which makes it much cheaper than
+ * coalescing. */
+AS::InstrList* PropagateCopies(AS::InstrList* il, F::Frame* f);
+
+}  // namespace OPT
+
+#endif  // TIGER_OPT_COPYPROP_H_
@@ -0,0 +1,93 @@
+#include "tiger/opt/effects.h"
+
+#include "tiger/frame/frame.h"
+
+namespace OPT {
+
+int FrameDepth(T::Exp* exp) {
+  if (exp->kind == T::Exp::Kind::TEMP)
+    return static_cast<T::TempExp*>(exp)->temp == F::FP() ? 0 : -1;
+  FrameSlot slot;
+  if (exp->kind == T::Exp::Kind::MEM &&
+      IsFrameSlot(static_cast<T::MemExp*>(exp)->exp, &slot) &&
+      slot.second == -F::wordSize)
+    return slot.first + 1;
+  return -1;
+}
+
+bool IsFrameSlot(T::Exp* addr, FrameSlot* slot) {
+  if (addr->kind != T::Exp::Kind::BINOP) return false;
+  T::BinopExp* binop = static_cast<T::BinopExp*>(addr);
+  if (binop->op != T::PLUS_OP || binop->right->kind != T::Exp::Kind::CONST)
+    return false;
+  int depth = FrameDepth(binop->left);
+  if (depth < 0) return false;
+  *slot = FrameSlot(depth, static_cast<T::ConstExp*>(binop->right)->consti);
+  return true;
+}
+
+bool IsRegister(TEMP::Temp* temp) {
+  return TEMP::inTempList(temp, F::registers());
+}
+
+bool HasCall(T::Exp* exp) {
+  switch (exp->kind) {
+    case T::Exp::Kind::CALL:
+      return true;
+    case T::Exp::Kind::BINOP:
+      return HasCall(static_cast<T::BinopExp*>(exp)->left) ||
+             HasCall(static_cast<T::BinopExp*>(exp)->right);
+    case T::Exp::Kind::MEM:
+      return HasCall(static_cast<T::MemExp*>(exp)->exp);
+    default:
+      return false;
+  }
+}
+
+FramePointers::FramePointers(const std::vector<T::StmList*>& blocks) {
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (T::StmList* block : blocks) {
+      for (T::StmList* cell = block; cell; cell = cell->tail) {
+        if (cell->head->kind != T::Stm::Kind::MOVE) continue;
+        T::MoveStm* move = static_cast<T::MoveStm*>(cell->head);
+        if (move->dst->kind != T::Exp::Kind::TEMP) continue;
+        TEMP::Temp* temp = static_cast<T::TempExp*>(move->dst)->temp;
+        if (!temps.count(temp) && MayPointToFrame(move->src)) {
+          temps.insert(temp);
+          changed = true;
+        }
+      }
+    }
+  }
+}
+
+bool FramePointers::MayPointToFrame(T::Exp* exp) const {
+  switch (exp->kind) {
+    case T::Exp::Kind::TEMP: {
+      TEMP::Temp* temp = static_cast<T::TempExp*>(exp)->temp;
+      return temp == F::FP() || IsRegister(temp) || temps.count(temp);
+    }
+    case T::Exp::Kind::BINOP: {
+      T::BinopExp* binop = static_cast<T::BinopExp*>(exp);
+      return MayPointToFrame(binop->left) || MayPointToFrame(binop->right);
+    }
+    case T::Exp::Kind::MEM: {
+      T::Exp* addr = static_cast<T::MemExp*>(exp)->exp;
+      if (addr->kind == T::Exp::Kind::BINOP) {
+        T::BinopExp* binop = static_cast<T::BinopExp*>(addr);
+        if (binop->op == T::PLUS_OP &&
+            binop->right->kind == T::Exp::Kind::CONST)
+          return static_cast<T::ConstExp*>(binop->right)->consti ==
+                     -F::wordSize &&
+                 MayPointToFrame(binop->left);
+      }
+      return MayPointToFrame(addr);
+    }
+    default:
+      return false;
+  }
+}
+
+}  // namespace OPT
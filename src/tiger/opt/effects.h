@@ -0,0 +1,46 @@
+#ifndef TIGER_OPT_EFFECTS_H_
+#define TIGER_OPT_EFFECTS_H_
+
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "tiger/frame/temp.h"
+#include "tiger/translate/tree.h"
+
+namespace OPT {
+
+using FrameSlot = std::pair<int, int>;  // static-link depth, offset
+
+/* Recognizes the `framePtr + offset` addresses built by InFrameAccess */
+bool IsFrameSlot(T::Exp* addr, FrameSlot* slot);
+
+/* Number of static links followed to reach the frame exp points to: 0 for
+ * FP itself and -1 when exp is not a frame pointer at all. The static link
+ * is the first escaping formal, so X64Frame keeps it at FP - wordSize and
+ * nothing but the prologue ever stores to that slot. */
+int FrameDepth(T::Exp* exp);
+
+/* Is temp one of the machine registers */
+bool IsRegister(TEMP::Temp* temp);
+
+bool HasCall(T::Exp* exp);
+
+/* Temps of one procedure that may hold a frame pointer or an address into
+ * a frame: static links copied out of their slot, for instance, or FP
+ * passed on by the inliner. Only the static-link slots of frames hold
+ * frame pointers, so the moves of blocks are followed to a fixpoint. */
+class FramePointers {
+ public:
+  explicit FramePointers(const std::vector<T::StmList*>& blocks);
+
+  /* Could exp evaluate to a frame pointer or into a frame */
+  bool MayPointToFrame(T::Exp* exp) const;
+
+ private:
+  std::set<TEMP::Temp*> temps;
+};
+
+}  // namespace OPT
+
+#endif  // TIGER_OPT_EFFECTS_H_
@@ -0,0 +1,69 @@
+#include "tiger/opt/layout.h"
+
+#include <string>
+
+#include "tiger/opt/blockgraph.h"
+#include "tiger/opt/profile.h"
+
+namespace {
+
+const double LOOP_WEIGHT = 8;
+const double SLOW_PATH_WEIGHT = 1.0 / 64;
+const int MAX_DEPTH = 6;
+
+// Name of the runtime function a statement calls, "" if none
+std::string calledFunction(T::Stm* stm) {
+  T::Exp* exp = nullptr;
+  if (stm->kind == T::Stm::Kind::EXP)
+    exp = static_cast<T::ExpStm*>(stm)->exp;
+  else if (stm->kind == T::Stm::Kind::MOVE)
+    exp = static_cast<T::MoveStm*>(stm)->src;
+  if (!exp || exp->kind != T::Exp::Kind::CALL) return "";
+  T::Exp* fun = static_cast<T::CallExp*>(exp)->fun;
+  if (fun->kind != T::Exp::Kind::NAME) return "";
+  return static_cast<T::NameExp*>(fun)->name->Name();
+}
+
+// Number of natural loops around each block
+std::vector<int> loopDepths(const OPT::BlockGraph& graph) {
+  std::vector<int> depth(graph.blocks.size(), 0);
+  for (const OPT::NaturalLoop& loop : OPT::NaturalLoops(graph))
+    for (int b : loop.body) depth[b]++;
+  return depth;
+}
+
+}  // namespace
+
+namespace OPT {
+
+std::vector<double> BlockFrequencies(C::Block block) {
+  BlockGraph graph(block);
+  int n = graph.blocks.size();
+  std::vector<double> freq(n, 0);
+
+  bool profiled = false;
+  for (int b = 0; b < n; b++) {
+    long count = ProfileCount(BlockName(graph.LabelOf(b)));
+    profiled = profiled || count >= 0;
+    freq[b] = count > 0 ? count : 0;
+  }
+  if (profiled) return freq;
+
+  std::vector<int> depth = loopDepths(graph);
+  for (int b = 0; b < n; b++) {
+    freq[b] = 1;
+    for (int d = 0; d < depth[b] && d < MAX_DEPTH; d++) freq[b] *= LOOP_WEIGHT;
+    int length = 0;
+    bool slowPath = false;
+    for (T::StmList* l = graph.blocks[b]; l; l = l->tail, ++length) {
+      std::string callee = calledFunction(l->head);
+      if (callee == "exit" || callee == "boundsError") freq[b] = 0;
+      slowPath = slowPath || callee == "allocRecord";
+    }
+    // LABEL, MOVE(TEMP r, CALL allocRecord), JUMP, see Record in translate.cc
+    if (slowPath && length == 3) freq[b] *= SLOW_PATH_WEIGHT;
+  }
+  return freq;
+}
+
+}  // namespace OPT
@@ -0,0 +1,21 @@
+#ifndef TIGER_OPT_LAYOUT_H_
+#define TIGER_OPT_LAYOUT_H_
+
+#include <vector>
+
+#include "tiger/canon/canon.h"
+
+namespace OPT {
+
+/* Estimated execution frequency of every block of one procedure, in the
+ * order of block.stmLists, for C::TraceSchedule. The block counts of the
+ * profile are used when --profile-use gave some for this function.
+ * Otherwise a block weighs 8 per enclosing natural loop, a block calling
+ * exit or boundsError weighs nothing and the allocRecord slow path of an
+ * inline allocation is assumed rare. Blocks must be named by NameBlocks
+ * first. */
+std::vector<double> BlockFrequencies(C::Block block);
+
+}  // namespace OPT
+
+#endif  // TIGER_OPT_LAYOUT_H_
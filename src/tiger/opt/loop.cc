@@ -0,0 +1,490 @@
+#include "tiger/opt/loop.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "tiger/frame/frame.h"
+#include "tiger/opt/blockgraph.h"
+#include "tiger/opt/effects.h"
+
+namespace {
+
+using OPT::FrameSlot;
+
+class Loop : public OPT::NaturalLoop {
+ public:
+  // Effects of the loop body, filled in by scanEffects
+  std::set<TEMP::Temp*> defs;
+  std::set<FrameSlot> frameStores;
+  bool heapStores;   // through addresses that are not frame slots
+  bool frameAliases; // some of them may point into a frame
+  bool calls;
+
+  explicit Loop(const OPT::NaturalLoop& loop)
+      : OPT::NaturalLoop(loop), heapStores(false), frameAliases(false),
+        calls(false) {}
+};
+
+class Family {
+ public:
+  TEMP::Temp* iv;
+  TEMP::Temp* base;
+  int scale;
+  TEMP::Temp* temp;  // always holds base + iv * scale inside the loop
+
+  Family(TEMP::Temp* iv, TEMP::Temp* base, int scale, TEMP::Temp* temp)
+      : iv(iv), base(base), scale(scale), temp(temp) {}
+};
+
+bool hasMem(T::Exp* exp) {
+  switch (exp->kind) {
+    case T::Exp::Kind::MEM:
+      return true;
+    case T::Exp::Kind::BINOP:
+      return hasMem(static_cast<T::BinopExp*>(exp)->left) ||
+             hasMem(static_cast<T::BinopExp*>(exp)->right);
+    default:
+      return false;
+  }
+}
+
+bool sameExp(T::Exp* a, T::Exp* b) {
+  if (a->kind != b->kind) return false;
+  switch (a->kind) {
+    case T::Exp::Kind::CONST:
+      return static_cast<T::ConstExp*>(a)->consti ==
+             static_cast<T::ConstExp*>(b)->consti;
+    case T::Exp::Kind::NAME:
+      return static_cast<T::NameExp*>(a)->name ==
+             static_cast<T::NameExp*>(b)->name;
+    case T::Exp::Kind::TEMP:
+      return static_cast<T::TempExp*>(a)->temp ==
+             static_cast<T::TempExp*>(b)->temp;
+    case T::Exp::Kind::MEM:
+      return sameExp(static_cast<T::MemExp*>(a)->exp,
+                     static_cast<T::MemExp*>(b)->exp);
+    case T::Exp::Kind::BINOP: {
+      T::BinopExp* x = static_cast<T::BinopExp*>(a);
+      T::BinopExp* y = static_cast<T::BinopExp*>(b);
+      return x->op == y->op && sameExp(x->left, y->left) &&
+             sameExp(x->right, y->right);
+    }
+    default:
+      return false;
+  }
+}
+
+std::vector<Loop> findLoops(const OPT::BlockGraph& graph) {
+  std::vector<Loop> loops;
+  for (const OPT::NaturalLoop& loop : OPT::NaturalLoops(graph))
+    loops.push_back(Loop(loop));
+  return loops;
+}
+
+void scanEffects(Loop* loop, const OPT::FramePointers& framePointers,
+                 T::Stm* stm) {
+  switch (stm->kind) {
+    case T::Stm::Kind::MOVE: {
+      T::MoveStm* move = static_cast<T::MoveStm*>(stm);
+      if (move->dst->kind == T::Exp::Kind::TEMP) {
+        loop->defs.insert(static_cast<T::TempExp*>(move->dst)->temp);
+      } else if (move->dst->kind == T::Exp::Kind::MEM) {
+        T::Exp* addr = static_cast<T::MemExp*>(move->dst)->exp;
+        FrameSlot slot;
+        if (OPT::IsFrameSlot(addr, &slot)) {
+          loop->frameStores.insert(slot);
+        } else {
+          loop->heapStores = true;
+          loop->frameAliases =
+              loop->frameAliases || framePointers.MayPointToFrame(addr);
+        }
+        loop->calls = loop->calls || OPT::HasCall(addr);
+      }
+      loop->calls = loop->calls || OPT::HasCall(move->src);
+      break;
+    }
+    case T::Stm::Kind::EXP:
+      loop->calls = loop->calls || OPT::HasCall(static_cast<T::ExpStm*>(stm)->exp);
+      break;
+    case T::Stm::Kind::CJUMP:
+      loop->calls = loop->calls ||
+                    OPT::HasCall(static_cast<T::CjumpStm*>(stm)->left) ||
+                    OPT::HasCall(static_cast<T::CjumpStm*>(stm)->right);
+      break;
+    default:
+      break;
+  }
+}
+
+/* An expression is invariant when every evaluation inside the loop yields
+ * the same value as evaluating it once in the preheader. Loads from the
+ * heap may fault, so they only qualify in the header block, which runs
+ * whenever the preheader does. A store through a temp that may hold a
+ * frame pointer can hit any frame slot but a static link, and a frame
+ * slot store can hit any load through such a temp. */
+bool invariant(const Loop& loop, const OPT::FramePointers& framePointers,
+               T::Exp* exp, bool atHeader) {
+  switch (exp->kind) {
+    case T::Exp::Kind::CONST:
+    case T::Exp::Kind::NAME:
+      return true;
+    case T::Exp::Kind::TEMP: {
+      TEMP::Temp* temp = static_cast<T::TempExp*>(exp)->temp;
+      return temp == F::FP() || (!OPT::IsRegister(temp) && !loop.defs.count(temp));
+    }
+    case T::Exp::Kind::BINOP: {
+      T::BinopExp* binop = static_cast<T::BinopExp*>(exp);
+      return binop->op != T::DIV_OP &&
+             invariant(loop, framePointers, binop->left, atHeader) &&
+             invariant(loop, framePointers, binop->right, atHeader);
+    }
+    case T::Exp::Kind::MEM: {
+      T::Exp* addr = static_cast<T::MemExp*>(exp)->exp;
+      if (!invariant(loop, framePointers, addr, atHeader)) return false;
+      FrameSlot slot;
+      if (OPT::IsFrameSlot(addr, &slot))
+        return slot.second == -F::wordSize ||
+               (!loop.calls && !loop.frameStores.count(slot) &&
+                !loop.frameAliases);
+      return atHeader && !loop.calls && !loop.heapStores &&
+             (loop.frameStores.empty() || !framePointers.MayPointToFrame(addr));
+    }
+    default:
+      return false;
+  }
+}
+
+class Hoister {
+ public:
+  std::vector<std::pair<T::Exp*, TEMP::Temp*>> hoisted;
+
+  Hoister(const Loop& loop, const OPT::FramePointers& framePointers)
+      : loop(loop), framePointers(framePointers) {}
+
+  /* Returns stm with its invariant loads replaced by temps. Trees may be
+   * shared with code outside the loop, so changed nodes are copied. */
+  T::Stm* Rewrite(T::Stm* stm, bool atHeader) {
+    switch (stm->kind) {
+      case T::Stm::Kind::MOVE: {
+        T::MoveStm* move = static_cast<T::MoveStm*>(stm);
+        T::Exp* dst = move->dst;
+        if (dst->kind == T::Exp::Kind::MEM) {
+          T::Exp* addr = static_cast<T::MemExp*>(dst)->exp;
+          T::Exp* newAddr = Rewrite(addr, atHeader);
+          if (newAddr != addr) dst = new T::MemExp(newAddr);
+        }
+        T::Exp* src = Rewrite(move->src, atHeader);
+        if (dst == move->dst && src == move->src) return stm;
+        return new T::MoveStm(dst, src);
+      }
+      case T::Stm::Kind::EXP: {
+        T::Exp* exp = static_cast<T::ExpStm*>(stm)->exp;
+        T::Exp* newExp = Rewrite(exp, atHeader);
+        return newExp == exp ? stm : new T::ExpStm(newExp);
+      }
+      case T::Stm::Kind::CJUMP: {
+        T::CjumpStm* cjump = static_cast<T::CjumpStm*>(stm);
+        T::Exp* left = Rewrite(cjump->left, atHeader);
+        T::Exp* right = Rewrite(cjump->right, atHeader);
+        if (left == cjump->left && right == cjump->right) return stm;
+        return new T::CjumpStm(cjump->op, left, right, cjump->true_label,
+                               cjump->false_label);
+      }
+      default:
+        return stm;
+    }
+  }
+
+ private:
+  const Loop& loop;
+  const OPT::FramePointers& framePointers;
+
+  TEMP::Temp* TempFor(T::Exp* exp) {
+    for (auto& h : hoisted)
+      if (sameExp(h.first, exp)) return h.second;
+    TEMP::Temp* temp = TEMP::Temp::NewTemp();
+    hoisted.push_back(std::make_pair(exp, temp));
+    return temp;
+  }
+
+  T::Exp* Rewrite(T::Exp* exp, bool atHeader) {
+    if (hasMem(exp) && invariant(loop, framePointers, exp, atHeader))
+      return new T::TempExp(TempFor(exp));
+    switch (exp->kind) {
+      case T::Exp::Kind::BINOP: {
+        T::BinopExp* binop = static_cast<T::BinopExp*>(exp);
+        T::Exp* left = Rewrite(binop->left, atHeader);
+        T::Exp* right = Rewrite(binop->right, atHeader);
+        if (left == binop->left && right == binop->right) return exp;
+        return new T::BinopExp(binop->op, left, right);
+      }
+      case T::Exp::Kind::MEM: {
+        T::Exp* addr = static_cast<T::MemExp*>(exp)->exp;
+        T::Exp* newAddr = Rewrite(addr, atHeader);
+        return newAddr == addr ? exp : new T::MemExp(newAddr);
+      }
+      case T::Exp::Kind::CALL: {
+        T::CallExp* call = static_cast<T::CallExp*>(exp);
+        bool changed = false;
+        std::vector<T::Exp*> args;
+        for (T::ExpList* l = call->args; l; l = l->tail) {
+          args.push_back(Rewrite(l->head, atHeader));
+          changed = changed || args.back() != l->head;
+        }
+        if (!changed) return exp;
+        T::ExpList* argList = nullptr;
+        for (int i = args.size() - 1; i >= 0; i--)
+          argList = new T::ExpList(args[i], argList);
+        return new T::CallExp(call->fun, argList, call->tail);
+      }
+      default:
+        return exp;
+    }
+  }
+};
+
+/* Matches `i := i + c` and `i := i - c` */
+bool basicStep(T::Stm* stm, TEMP::Temp** var, int* step) {
+  if (stm->kind != T::Stm::Kind::MOVE) return false;
+  T::MoveStm* move = static_cast<T::MoveStm*>(stm);
+  if (move->dst->kind != T::Exp::Kind::TEMP ||
+      move->src->kind != T::Exp::Kind::BINOP)
+    return false;
+  TEMP::Temp* temp = static_cast<T::TempExp*>(move->dst)->temp;
+  T::BinopExp* binop = static_cast<T::BinopExp*>(move->src);
+  if ((binop->op != T::PLUS_OP && binop->op != T::MINUS_OP) ||
+      binop->left->kind != T::Exp::Kind::TEMP ||
+      static_cast<T::TempExp*>(binop->left)->temp != temp ||
+      binop->right->kind != T::Exp::Kind::CONST)
+    return false;
+  int c = static_cast<T::ConstExp*>(binop->right)->consti;
+  *var = temp;
+  *step = binop->op == T::PLUS_OP ? c : -c;
+  return true;
+}
+
+class StrengthReducer {
+ public:
+  std::vector<Family> families;
+
+  StrengthReducer(const Loop& loop, const std::set<TEMP::Temp*>& ivs)
+      : loop(loop), ivs(ivs) {}
+
+  T::Stm* Rewrite(T::Stm* stm) {
+    switch (stm->kind) {
+      case T::Stm::Kind::MOVE: {
+        T::MoveStm* move = static_cast<T::MoveStm*>(stm);
+        T::Exp* dst = move->dst;
+        if (dst->kind == T::Exp::Kind::MEM) {
+          T::Exp* addr = static_cast<T::MemExp*>(dst)->exp;
+          T::Exp* newAddr = Rewrite(addr);
+          if (newAddr != addr) dst = new T::MemExp(newAddr);
+        }
+        T::Exp* src = Rewrite(move->src);
+        if (dst == move->dst && src == move->src) return stm;
+        return new T::MoveStm(dst, src);
+      }
+      case T::Stm::Kind::EXP: {
+        T::Exp* exp = static_cast<T::ExpStm*>(stm)->exp;
+        T::Exp* newExp = Rewrite(exp);
+        return newExp == exp ? stm : new T::ExpStm(newExp);
+      }
+      case T::Stm::Kind::CJUMP: {
+        T::CjumpStm* cjump = static_cast<T::CjumpStm*>(stm);
+        T::Exp* left = Rewrite(cjump->left);
+        T::Exp* right = Rewrite(cjump->right);
+        if (left == cjump->left && right == cjump->right) return stm;
+        return new T::CjumpStm(cjump->op, left, right, cjump->true_label,
+                               cjump->false_label);
+      }
+      default:
+        return stm;
+    }
+  }
+
+ private:
+  const Loop& loop;
+  const std::set<TEMP::Temp*>& ivs;
+
+  /* Matches `base + iv * scale` with an invariant base temp */
+  bool Derived(T::Exp* exp, TEMP::Temp** iv, TEMP::Temp** base, int* scale) {
+    if (exp->kind != T::Exp::Kind::BINOP) return false;
+    T::BinopExp* plus = static_cast<T::BinopExp*>(exp);
+    if (plus->op != T::PLUS_OP || plus->left->kind != T::Exp::Kind::TEMP ||
+        plus->right->kind != T::Exp::Kind::BINOP)
+      return false;
+    T::BinopExp* mul = static_cast<T::BinopExp*>(plus->right);
+    if (mul->op != T::MUL_OP || mul->left->kind != T::Exp::Kind::TEMP ||
+        mul->right->kind != T::Exp::Kind::CONST)
+      return false;
+    TEMP::Temp* b = static_cast<T::TempExp*>(plus->left)->temp;
+    TEMP::Temp* i = static_cast<T::TempExp*>(mul->left)->temp;
+    if (!ivs.count(i) || b == F::FP() || OPT::IsRegister(b) || loop.defs.count(b))
+      return false;
+    *iv = i;
+    *base = b;
+    *scale = static_cast<T::ConstExp*>(mul->right)->consti;
+    return true;
+  }
+
+  T::Exp* Rewrite(T::Exp* exp) {
+    TEMP::Temp *iv, *base;
+    int scale;
+    if (Derived(exp, &iv, &base, &scale)) {
+      for (auto& family : families)
+        if (family.iv == iv && family.base == base && family.scale == scale)
+          return new T::TempExp(family.temp);
+      families.push_back(Family(iv, base, scale, TEMP::Temp::NewTemp()));
+      return new T::TempExp(families.back().temp);
+    }
+    switch (exp->kind) {
+      case T::Exp::Kind::BINOP: {
+        T::BinopExp* binop = static_cast<T::BinopExp*>(exp);
+        T::Exp* left = Rewrite(binop->left);
+        T::Exp* right = Rewrite(binop->right);
+        if (left == binop->left && right == binop->right) return exp;
+        return new T::BinopExp(binop->op, left, right);
+      }
+      case T::Exp::Kind::MEM: {
+        T::Exp* addr = static_cast<T::MemExp*>(exp)->exp;
+        T::Exp* newAddr = Rewrite(addr);
+        return newAddr == addr ? exp : new T::MemExp(newAddr);
+      }
+      case T::Exp::Kind::CALL: {
+        T::CallExp* call = static_cast<T::CallExp*>(exp);
+        bool changed = false;
+        std::vector<T::Exp*> args;
+        for (T::ExpList* l = call->args; l; l = l->tail) {
+          args.push_back(Rewrite(l->head));
+          changed = changed || args.back() != l->head;
+        }
+        if (!changed) return exp;
+        T::ExpList* argList = nullptr;
+        for (int i = args.size() - 1; i >= 0; i--)
+          argList = new T::ExpList(args[i], argList);
+        return new T::CallExp(call->fun, argList, call->tail);
+      }
+      default:
+        return exp;
+    }
+  }
+};
+
+void optimizeLoop(OPT::BlockGraph* graph, Loop* loop) {
+  // Preheaders of inner loops add temps holding static links
+  OPT::FramePointers framePointers(graph->blocks);
+  for (int b : loop->body)
+    for (T::StmList* cell = graph->blocks[b]; cell; cell = cell->tail)
+      scanEffects(loop, framePointers, cell->head);
+
+  // 1. Hoist invariant loads
+  Hoister hoister(*loop, framePointers);
+  for (int b : loop->body)
+    for (T::StmList* cell = graph->blocks[b]; cell; cell = cell->tail)
+      cell->head = hoister.Rewrite(cell->head, b == loop->header);
+
+  // 2. Find basic induction variables: temps only ever stepped by constants
+  std::map<TEMP::Temp*, std::vector<std::pair<T::StmList*, int>>> steps;
+  std::set<TEMP::Temp*> others;
+  for (int b : loop->body) {
+    for (T::StmList* cell = graph->blocks[b]; cell; cell = cell->tail) {
+      TEMP::Temp* var;
+      int step;
+      if (basicStep(cell->head, &var, &step)) {
+        steps[var].push_back(std::make_pair(cell, step));
+      } else if (cell->head->kind == T::Stm::Kind::MOVE) {
+        T::Exp* dst = static_cast<T::MoveStm*>(cell->head)->dst;
+        if (dst->kind == T::Exp::Kind::TEMP)
+          others.insert(static_cast<T::TempExp*>(dst)->temp);
+      }
+    }
+  }
+  std::set<TEMP::Temp*> ivs;
+  for (auto& entry : steps)
+    if (!others.count(entry.first) && !OPT::IsRegister(entry.first))
+      ivs.insert(entry.first);
+
+  // 3. Replace base + iv * scale by a temp bumped along with iv
+  StrengthReducer reducer(*loop, ivs);
+  if (!ivs.empty()) {
+    for (int b : loop->body)
+      for (T::StmList* cell = graph->blocks[b]; cell; cell = cell->tail)
+        cell->head = reducer.Rewrite(cell->head);
+    for (auto& family : reducer.families) {
+      for (auto& step : steps[family.iv]) {
+        T::StmList* cell = step.first;
+        cell->tail = new T::StmList(
+            new T::MoveStm(new T::TempExp(family.temp),
+                           new T::BinopExp(T::PLUS_OP,
+                                           new T::TempExp(family.temp),
+                                           new T::ConstExp(step.second *
+                                                           family.scale))),
+            cell->tail);
+      }
+    }
+  }
+
+  if (hoister.hoisted.empty() && reducer.families.empty()) return;
+
+  // 4. Build the preheader and route every entry into the loop through it
+  int header = loop->header;
+  TEMP::Label* headerLabel = graph->LabelOf(header);
+  TEMP::Label* preheaderLabel = TEMP::NewLabel();
+  T::StmList* jump = new T::StmList(
+      new T::JumpStm(new T::NameExp(headerLabel),
+                     new TEMP::LabelList(headerLabel, nullptr)),
+      nullptr);
+  T::StmList* inits = jump;
+  for (int i = reducer.families.size() - 1; i >= 0; i--) {
+    Family& family = reducer.families[i];
+    inits = new T::StmList(
+        new T::MoveStm(
+            new T::TempExp(family.temp),
+            new T::BinopExp(T::PLUS_OP, new T::TempExp(family.base),
+                            new T::BinopExp(T::MUL_OP,
+                                            new T::TempExp(family.iv),
+                                            new T::ConstExp(family.scale)))),
+        inits);
+  }
+  for (int i = hoister.hoisted.size() - 1; i >= 0; i--)
+    inits = new T::StmList(
+        new T::MoveStm(new T::TempExp(hoister.hoisted[i].second),
+                       hoister.hoisted[i].first),
+        inits);
+  T::StmList* preheader =
+      new T::StmList(new T::LabelStm(preheaderLabel), inits);
+
+  for (int p : graph->preds[header]) {
+    if (loop->contains[p]) continue;
+    T::StmList* last = graph->LastCell(p);
+    last->head = OPT::RetargetJump(last->head, headerLabel, preheaderLabel);
+  }
+  graph->blocks.insert(graph->blocks.begin() + header, preheader);
+  graph->Build();
+}
+
+}  // namespace
+
+namespace OPT {
+
+C::Block OptimizeLoops(C::Block block) {
+  BlockGraph graph(block);
+  std::set<TEMP::Label*> done;
+  while (true) {
+    std::vector<Loop> loops = findLoops(graph);
+    Loop* next = nullptr;
+    for (Loop& loop : loops) {
+      if (!done.count(graph.LabelOf(loop.header))) {
+        next = &loop;
+        break;
+      }
+    }
+    if (!next) break;
+    done.insert(graph.LabelOf(next->header));
+    optimizeLoop(&graph, next);
+  }
+  return graph.ToBlock();
+}
+
+}  // namespace OPT
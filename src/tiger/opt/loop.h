@@ -0,0 +1,21 @@
+#ifndef TIGER_OPT_LOOP_H_
+#define TIGER_OPT_LOOP_H_
+
+#include "tiger/canon/canon.h"
+
+namespace OPT {
+
+/* Loop optimizations over the canonical basic blocks of one procedure.
+ * Natural loops are found from the back edges of the block graph and are
+ * processed innermost first. For each loop:
+ *   1. invariant loads (static-link chains, frame slots nobody stores to,
+ *      array bases) are hoisted into a new preheader block;
+ *   2. `base + i*size` addressing on a basic induction variable i is
+ *      strength-reduced into a pointer bumped next to every update of i.
+ * The result still satisfies the BasicBlocks properties and can be handed
+ * to C::TraceSchedule directly. */
+C::Block OptimizeLoops(C::Block block);
+
+}  // namespace OPT
+
+#endif  // TIGER_OPT_LOOP_H_
@@ -0,0 +1,68 @@
+#include "tiger/opt/profile.h"
+
+#include <fstream>
+#include <map>
+#include <sstream>
+
+namespace {
+
+std::map<TEMP::Label*, std::string> blockNames;
+std::map<std::string, int> counterIndex;
+std::vector<std::string> counters;
+std::map<std::string, long> counts;
+bool haveProfile = false;
+
+}  // namespace
+
+namespace OPT {
+
+void NameBlocks(TEMP::Label* function, const C::Block& block) {
+  int i = 0;
+  for (C::StmListList* b = block.stmLists; b; b = b->tail, ++i) {
+    T::LabelStm* label = static_cast<T::LabelStm*>(b->head->head);
+    blockNames[label->label] = function->Name() + "#" + std::to_string(i);
+  }
+}
+
+const std::string& BlockName(TEMP::Label* label) {
+  static const std::string none;
+  auto it = blockNames.find(label);
+  return it == blockNames.end() ? none : it->second;
+}
+
+std::string CountInstr(const std::string& name) {
+  auto it = counterIndex.find(name);
+  if (it == counterIndex.end()) {
+    it = counterIndex.insert(std::make_pair(name, counters.size())).first;
+    counters.push_back(name);
+  }
+  return "incq tiger_profile_counts+" + std::to_string(it->second * 8) +
+         "(%rip)";
+}
+
+const std::vector<std::string>& ProfileCounters() { return counters; }
+
+// One counter per line, "count name", see profile_dump in runtime.c
+bool ReadProfile(const std::string& fileName) {
+  std::ifstream in(fileName);
+  if (!in.good()) return false;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#') continue;
+    std::istringstream fields(line);
+    long count;
+    std::string name;
+    if (fields >> count >> name) counts[name] += count;
+  }
+  haveProfile = true;
+  return true;
+}
+
+bool HaveProfile() { return haveProfile; }
+
+long ProfileCount(const std::string& name) {
+  auto it = counts.find(name);
+  return it == counts.end() ? -1 : it->second;
+}
+
+}  // namespace OPT
@@ -0,0 +1,39 @@
+#ifndef TIGER_OPT_PROFILE_H_
+#define TIGER_OPT_PROFILE_H_
+
+#include <string>
+#include <vector>
+
+#include "tiger/canon/canon.h"
+#include "tiger/frame/temp.h"
+
+namespace OPT {
+
+/* Execution counts, written by the runtime of a program compiled with
+ * --profile and read back with --profile-use. Counters are named by the
+ * function, "f", or by one of its blocks, "f#i" for the i-th block handed
+ * to C::TraceSchedule. Block numbers, unlike labels, do not depend on what
+ * the other functions did, so they match between the two compiles as long
+ * as the source and the other options stay the same. */
+
+/* Names the blocks of one procedure, before they are scheduled */
+void NameBlocks(TEMP::Label* function, const C::Block& block);
+
+/* The name given to the block starting at label, "" for other labels */
+const std::string& BlockName(TEMP::Label* label);
+
+/* Instruction adding one to the counter called name, which is created on
+ * first use and listed by main.cc in tiger_profile_names */
+std::string CountInstr(const std::string& name);
+const std::vector<std::string>& ProfileCounters();
+
+/* Loads a profile, false if the file cannot be read */
+bool ReadProfile(const std::string& fileName);
+bool HaveProfile();
+
+/* The count recorded for name, -1 if the profile has none */
+long ProfileCount(const std::string& name);
+
+}  // namespace OPT
+
+#endif  // TIGER_OPT_PROFILE_H_
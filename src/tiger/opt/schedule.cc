@@ -0,0 +1,293 @@
+#include "tiger/opt/schedule.h"
+
+#include <algorithm>
+#include <cassert>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "tiger/frame/frame.h"
+
+namespace {
+
+// Rough result latencies of recent x86-64 cores, in cycles
+const int LOAD_LATENCY = 4;
+const int MUL_LATENCY = 3;
+const int DIV_LATENCY = 26;
+
+// Past this many values live at once, the scheduler stops starting new
+// ones if it can help it; keeps a few registers for the allocator's use
+const int PRESSURE_LIMIT = F::K - 4;
+
+// Longer runs are cut, which keeps picking the next instruction cheap
+const int MAX_RUN = 256;
+
+/* One instruction of a run being scheduled */
+struct Node {
+  AS::Instr* instr;
+  int latency;
+  bool load, store, flags;
+  std::vector<std::pair<int, int>> succs;  // (node, delay)
+  int preds = 0;    // not yet scheduled
+  int height = 0;   // longest delay from here to the end of the run
+  int ready = 0;    // earliest cycle its operands are available
+};
+
+/* Is instr left out of scheduling, and where it belongs */
+bool IsBarrier(AS::Instr* instr) {
+  if (instr->kind == AS::Instr::Kind::LABEL)
+    return true;
+  if (instr->kind == AS::Instr::Kind::MOVE)
+    return false;
+  AS::OperInstr* oper = static_cast<AS::OperInstr*>(instr);
+  if (oper->jumps && (oper->jumps->labels || !oper->jumps->fallthrough))
+    return true;
+  std::string op = oper->assem.substr(0, oper->assem.find(' '));
+  return op != "movq" && op != "leaq" && op != "addq" && op != "subq" &&
+         op != "imulq" && op != "idivq" && op != "cqto" && op != "cmpq";
+}
+
+/* Fills in the latency and the effects of a non-barrier instruction. A
+ * parenthesized operand is a memory access, a store if it is the last
+ * operand; leaq only computes the address. */
+void Classify(Node* node) {
+  node->latency = 1;
+  node->load = node->store = node->flags = false;
+  if (node->instr->kind == AS::Instr::Kind::MOVE)
+    return;
+  const std::string& assem = static_cast<AS::OperInstr*>(node->instr)->assem;
+  std::string op = assem.substr(0, assem.find(' '));
+  node->flags = op == "addq" || op == "subq" || op == "imulq" ||
+                op == "idivq" || op == "cmpq";
+  if (op == "imulq")
+    node->latency = MUL_LATENCY;
+  else if (op == "idivq")
+    node->latency = DIV_LATENCY;
+  if (op == "leaq" || assem.find('(') == std::string::npos)
+    return;
+  int depth = 0;
+  std::size_t lastOperand = op.size();
+  for (std::size_t i = op.size(); i < assem.size(); ++i) {
+    if (assem[i] == '(')
+      depth++;
+    else if (assem[i] == ')')
+      depth--;
+    else if (assem[i] == ',' && depth == 0)
+      lastOperand = i;
+  }
+  if (assem.find('(', lastOperand) != std::string::npos) {
+    node->store = true;
+  } else {
+    node->load = true;
+    node->latency = LOAD_LATENCY;
+  }
+}
+
+void AddEdge(std::vector<Node>& nodes, int from, int to, int delay) {
+  if (from < 0 || from == to)
+    return;
+  nodes[from].succs.push_back(std::make_pair(to, delay));
+  nodes[to].preds++;
+}
+
+/* Builds the dependence graph of a run of instructions. If flagsRead, the
+ * instruction after the run reads the condition codes, so the last one to
+ * set them has to stay after every other. */
+std::vector<Node> Dependences(const std::vector<AS::Instr*>& run,
+                              bool flagsRead) {
+  int n = run.size();
+  std::vector<Node> nodes(n);
+  std::map<TEMP::Temp*, int> lastDef;
+  std::map<TEMP::Temp*, std::vector<int>> usesSinceDef;
+  int lastStore = -1;
+  std::vector<int> loadsSinceStore;
+  int lastFlags = -1;
+  for (int i = 0; i < n; ++i) {
+    nodes[i].instr = run[i];
+    Classify(&nodes[i]);
+    for (TEMP::TempList* use = run[i]->GetUse(); use; use = use->tail) {
+      std::map<TEMP::Temp*, int>::iterator def = lastDef.find(use->head);
+      if (def != lastDef.end())
+        AddEdge(nodes, def->second, i, nodes[def->second].latency);
+      usesSinceDef[use->head].push_back(i);
+    }
+    for (TEMP::TempList* def = run[i]->GetDef(); def; def = def->tail) {
+      std::map<TEMP::Temp*, int>::iterator prev = lastDef.find(def->head);
+      if (prev != lastDef.end())
+        AddEdge(nodes, prev->second, i, 1);
+      for (int use : usesSinceDef[def->head])
+        AddEdge(nodes, use, i, 0);
+      usesSinceDef[def->head].clear();
+      lastDef[def->head] = i;
+    }
+    if (nodes[i].load) {
+      AddEdge(nodes, lastStore, i, 1);
+      loadsSinceStore.push_back(i);
+    }
+    if (nodes[i].store) {
+      AddEdge(nodes, lastStore, i, 1);
+      for (int load : loadsSinceStore)
+        AddEdge(nodes, load, i, 0);
+      loadsSinceStore.clear();
+      lastStore = i;
+    }
+    if (nodes[i].flags)
+      lastFlags = i;
+  }
+  if (flagsRead && lastFlags >= 0) {
+    for (int i = 0; i < n; ++i) {
+      if (nodes[i].flags)
+        AddEdge(nodes, i, lastFlags, 0);
+    }
+  }
+
+  // Edges only go forward, so heights can be filled in backwards
+  for (int i = n - 1; i >= 0; --i) {
+    nodes[i].height = nodes[i].latency;
+    for (const std::pair<int, int>& succ : nodes[i].succs)
+      nodes[i].height = std::max(nodes[i].height, succ.second + nodes[succ.first].height);
+  }
+  return nodes;
+}
+
+/* How many of the values that are live within the run scheduling node
+ * would start, minus how many it would end */
+int PressureDelta(const Node& node, const std::map<TEMP::Temp*, int>& usesLeft) {
+  int delta = 0;
+  for (TEMP::TempList* def = node.instr->GetDef(); def; def = def->tail) {
+    std::map<TEMP::Temp*, int>::const_iterator left = usesLeft.find(def->head);
+    if (left != usesLeft.end() && left->second > 0)
+      delta++;
+  }
+  for (TEMP::TempList* use = node.instr->GetUse(); use; use = use->tail) {
+    std::map<TEMP::Temp*, int>::const_iterator left = usesLeft.find(use->head);
+    if (left != usesLeft.end() && left->second == 1)
+      delta--;
+  }
+  return delta;
+}
+
+void Schedule(std::vector<AS::Instr*>& run, bool flagsRead) {
+  int n = run.size();
+  if (n < 2)
+    return;
+  std::vector<Node> nodes = Dependences(run, flagsRead);
+
+  // Uses left in the run of each value defined in it; those with uses
+  // left after their definition is scheduled count as live
+  std::map<TEMP::Temp*, int> usesLeft;
+  for (AS::Instr* instr : run) {
+    for (TEMP::TempList* def = instr->GetDef(); def; def = def->tail)
+      usesLeft[def->head] = 0;
+  }
+  for (AS::Instr* instr : run) {
+    for (TEMP::TempList* use = instr->GetUse(); use; use = use->tail) {
+      std::map<TEMP::Temp*, int>::iterator left = usesLeft.find(use->head);
+      if (left != usesLeft.end())
+        left->second++;
+    }
+  }
+
+  std::vector<int> available;
+  for (int i = 0; i < n; ++i) {
+    if (nodes[i].preds == 0)
+      available.push_back(i);
+  }
+  std::vector<AS::Instr*> result;
+  int cycle = 0;
+  int live = 0;
+  while (!available.empty()) {
+    // Prefer what can issue now, then the longest path to the end; under
+    // pressure, first whatever frees registers. Ties keep the old order.
+    int best = -1;
+    int bestDelta = 0;
+    for (int candidate : available) {
+      int delta = PressureDelta(nodes[candidate], usesLeft);
+      if (best < 0) {
+        best = candidate;
+        bestDelta = delta;
+        continue;
+      }
+      const Node& c = nodes[candidate];
+      const Node& b = nodes[best];
+      bool better;
+      if (live >= PRESSURE_LIMIT && delta != bestDelta)
+        better = delta < bestDelta;
+      else if ((c.ready <= cycle) != (b.ready <= cycle))
+        better = c.ready <= cycle;
+      else if (c.ready > cycle && c.ready != b.ready)
+        better = c.ready < b.ready;
+      else if (c.height != b.height)
+        better = c.height > b.height;
+      else
+        better = candidate < best;
+      if (better) {
+        best = candidate;
+        bestDelta = delta;
+      }
+    }
+
+    Node& node = nodes[best];
+    cycle = std::max(cycle, node.ready) + 1;
+    live += bestDelta;
+    for (TEMP::TempList* use = node.instr->GetUse(); use; use = use->tail) {
+      std::map<TEMP::Temp*, int>::iterator left = usesLeft.find(use->head);
+      if (left != usesLeft.end())
+        left->second--;
+    }
+    result.push_back(node.instr);
+    available.erase(std::find(available.begin(), available.end(), best));
+    for (const std::pair<int, int>& succ : node.succs) {
+      Node& next = nodes[succ.first];
+      next.ready = std::max(next.ready, cycle - 1 + succ.second);
+      if (--next.preds == 0)
+        available.push_back(succ.first);
+    }
+  }
+  assert((int)result.size() == n);
+  run = result;
+}
+
+/* Does the instruction after a run read the condition codes */
+bool ReadsFlags(AS::Instr* instr) {
+  if (!instr || instr->kind != AS::Instr::Kind::OPER)
+    return false;
+  const std::string& assem = static_cast<AS::OperInstr*>(instr)->assem;
+  return assem[0] == 'j' && assem.compare(0, 4, "jmp ") != 0;
+}
+
+}  // namespace
+
+namespace OPT {
+
+AS::InstrList* ScheduleBlocks(AS::InstrList* il) {
+  std::vector<AS::Instr*> result;
+  std::vector<AS::Instr*> run;
+  for (AS::InstrList* head = il; ; head = head->tail) {
+    AS::Instr* instr = head ? head->head : nullptr;
+    if (instr && !IsBarrier(instr)) {
+      run.push_back(instr);
+      if ((int)run.size() < MAX_RUN)
+        continue;
+      // The condition codes may be read after the next piece
+      Schedule(run, true);
+      result.insert(result.end(), run.begin(), run.end());
+      run.clear();
+      continue;
+    }
+    Schedule(run, ReadsFlags(instr));
+    result.insert(result.end(), run.begin(), run.end());
+    run.clear();
+    if (!instr)
+      break;
+    result.push_back(instr);
+  }
+
+  AS::InstrList* list = nullptr;
+  for (std::size_t i = result.size(); i-- > 0;)
+    list = new AS::InstrList(result[i], list);
+  return list;
+}
+
+}  // namespace OPT
@@ -0,0 +1,20 @@
+#ifndef TIGER_OPT_SCHEDULE_H_
+#define TIGER_OPT_SCHEDULE_H_
+
+#include "tiger/codegen/assem.h"
+
+namespace OPT {
+
+/* List-schedules the instructions of one procedure before register
+ * allocation. Labels, jumps, calls and anything unrecognized stay where
+ * they are. The runs of instructions between them are reordered so that
+ * the results of loads, multiplies and divides are not used right away.
+ * Dependences come from the def and use lists, the order of memory
+ * accesses and the condition codes read by the closing jump. While many
+ * values are live, the scheduler prefers instructions that end live
+ * ranges over ones that start new ones. */
+AS::InstrList* ScheduleBlocks(AS::InstrList* il);
+
+}  // namespace OPT
+
+#endif  // TIGER_OPT_SCHEDULE_H_
@@ -0,0 +1,492 @@
+#include "tiger/opt/valnum.h"
+
+#include <cassert>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "tiger/frame/frame.h"
+#include "tiger/opt/blockgraph.h"
+#include "tiger/opt/effects.h"
+
+namespace {
+
+using OPT::FrameSlot;
+
+using Key = std::vector<std::intptr_t>;
+using Occurrence = std::pair<T::StmList*, T::Exp*>;
+
+enum KeyKind { CONST_KEY, NAME_KEY, ENTRY_KEY, BINOP_KEY, LOAD_KEY };
+
+/* What a load may read: one frame slot, memory no frame pointer reaches,
+ * or anything */
+enum MemClass { SLOT, HEAP, ANY };
+
+/* The value number of every temp and the version of every part of memory
+ * at one point of the procedure. Versions and value numbers are drawn
+ * from the same counter; 0 is the value on entry. */
+class State {
+ public:
+  std::map<TEMP::Temp*, int> temps;
+  std::map<FrameSlot, int> slots;
+  int heap = 0;    // bumped by stores to HEAP and calls
+  int frames = 0;  // by stores to ANY and calls, for every frame slot
+  int memory = 0;  // by every store and call
+};
+
+/* A first computation of a value, which saves it to holder once a later
+ * one wants it */
+class Leader {
+ public:
+  TEMP::Temp* holder = nullptr;
+};
+
+bool isCommutative(T::BinOp op) {
+  return op == T::PLUS_OP || op == T::MUL_OP || op == T::AND_OP ||
+         op == T::OR_OP || op == T::XOR_OP;
+}
+
+/* Worth keeping in a temp: a load, a multiply or divide, or arithmetic
+ * on more than plain temps and constants */
+bool isCandidate(T::Exp* exp) {
+  if (exp->kind == T::Exp::Kind::MEM) return true;
+  if (exp->kind != T::Exp::Kind::BINOP) return false;
+  T::BinopExp* binop = static_cast<T::BinopExp*>(exp);
+  if (binop->op == T::MUL_OP || binop->op == T::DIV_OP) return true;
+  for (T::Exp* child : {binop->left, binop->right})
+    if (child->kind == T::Exp::Kind::BINOP || child->kind == T::Exp::Kind::MEM)
+      return true;
+  return false;
+}
+
+class Numbering {
+ public:
+  std::map<Occurrence, TEMP::Temp*> replaced;
+  std::map<Occurrence, Leader*> leaders;
+
+  explicit Numbering(const OPT::BlockGraph& graph)
+      : graph(graph), framePointers(graph.blocks) {}
+
+  void Walk(int b, const State& parent) {
+    State state = parent;
+    if (b != 0)
+      for (int z : between(graph.idom[b], b))
+        for (T::StmList* cell = graph.blocks[z]; cell; cell = cell->tail)
+          kill(&state, cell->head);
+
+    std::vector<int> added;
+    for (T::StmList* cell = graph.blocks[b]; cell; cell = cell->tail)
+      visit(&state, cell, &added);
+    for (int c : children[b]) Walk(c, state);
+    for (int v : added) available.erase(v);
+  }
+
+  void Run() {
+    int n = graph.blocks.size();
+    children.assign(n, std::vector<int>());
+    for (int b : graph.rpo)
+      if (graph.idom[b] >= 0) children[graph.idom[b]].push_back(b);
+    if (n > 0 && graph.Reachable(0)) Walk(0, State());
+  }
+
+ private:
+  const OPT::BlockGraph& graph;
+  std::vector<std::vector<int>> children;
+  std::map<Key, int> table;
+  int count = 0;
+  OPT::FramePointers framePointers;                // may point into a frame
+  std::map<int, std::vector<TEMP::Temp*>> holders;  // temps ever given a value
+  std::map<int, Leader*> available;  // in the blocks dominating this one
+
+  int fresh() { return ++count; }
+
+  int number(const Key& key) {
+    auto it = table.find(key);
+    if (it != table.end()) return it->second;
+    int v = fresh();
+    table[key] = v;
+    return v;
+  }
+
+  MemClass classify(T::Exp* addr, FrameSlot* slot) {
+    if (OPT::IsFrameSlot(addr, slot)) return SLOT;
+    return framePointers.MayPointToFrame(addr) ? ANY : HEAP;
+  }
+
+  Key loadKey(const State& state, T::Exp* addr, int addrValue) {
+    FrameSlot slot;
+    MemClass memClass = classify(addr, &slot);
+    Key key = {LOAD_KEY, memClass, addrValue};
+    if (memClass == SLOT) {
+      auto it = state.slots.find(slot);
+      key.push_back(it == state.slots.end() ? 0 : it->second);
+      if (slot.second != -F::wordSize) key.push_back(state.frames);
+    } else {
+      key.push_back(memClass == HEAP ? state.heap : state.memory);
+    }
+    return key;
+  }
+
+  /* Blocks on some path from d to b that does not go through d again */
+  std::vector<int> between(int d, int b) {
+    std::vector<bool> seen(graph.blocks.size(), false);
+    std::vector<int> result;
+    std::vector<int> worklist(graph.preds[b]);
+    while (!worklist.empty()) {
+      int z = worklist.back();
+      worklist.pop_back();
+      if (z == d || seen[z] || !graph.Reachable(z)) continue;
+      seen[z] = true;
+      result.push_back(z);
+      for (int p : graph.preds[z]) worklist.push_back(p);
+    }
+    return result;
+  }
+
+  void store(State* state, T::Exp* addr) {
+    FrameSlot slot;
+    switch (classify(addr, &slot)) {
+      case SLOT:
+        state->slots[slot] = fresh();
+        break;
+      case HEAP:
+        state->heap = fresh();
+        break;
+      case ANY:
+        state->heap = fresh();
+        state->frames = fresh();
+        break;
+    }
+    state->memory = fresh();
+  }
+
+  void call(State* state) {
+    state->heap = fresh();
+    state->frames = fresh();
+    state->memory = fresh();
+  }
+
+  /* The effects of stm on state, without numbering anything */
+  void kill(State* state, T::Stm* stm) {
+    switch (stm->kind) {
+      case T::Stm::Kind::MOVE: {
+        T::MoveStm* move = static_cast<T::MoveStm*>(stm);
+        if (move->dst->kind == T::Exp::Kind::TEMP) {
+          state->temps[static_cast<T::TempExp*>(move->dst)->temp] = fresh();
+        } else {
+          T::Exp* addr = static_cast<T::MemExp*>(move->dst)->exp;
+          store(state, addr);
+          if (OPT::HasCall(addr)) call(state);
+        }
+        if (OPT::HasCall(move->src)) call(state);
+        break;
+      }
+      case T::Stm::Kind::EXP:
+        if (OPT::HasCall(static_cast<T::ExpStm*>(stm)->exp)) call(state);
+        break;
+      case T::Stm::Kind::CJUMP:
+        if (OPT::HasCall(static_cast<T::CjumpStm*>(stm)->left) ||
+            OPT::HasCall(static_cast<T::CjumpStm*>(stm)->right))
+          call(state);
+        break;
+      default:
+        break;
+    }
+  }
+
+  /* Value number of exp before the statement it is in runs; -1 for the
+   * result of a call, which is never reused */
+  int valueOf(const State& state, T::Exp* exp, std::map<T::Exp*, int>* memo) {
+    auto it = memo->find(exp);
+    if (it != memo->end()) return it->second;
+    int v = -1;
+    switch (exp->kind) {
+      case T::Exp::Kind::CONST:
+        v = number({CONST_KEY, static_cast<T::ConstExp*>(exp)->consti});
+        break;
+      case T::Exp::Kind::NAME:
+        v = number({NAME_KEY, reinterpret_cast<std::intptr_t>(
+                                  static_cast<T::NameExp*>(exp)->name)});
+        break;
+      case T::Exp::Kind::TEMP: {
+        TEMP::Temp* temp = static_cast<T::TempExp*>(exp)->temp;
+        // Calls change machine registers behind the IR's back
+        if (temp != F::FP() && OPT::IsRegister(temp)) break;
+        auto t = state.temps.find(temp);
+        v = t != state.temps.end()
+                ? t->second
+                : number({ENTRY_KEY, reinterpret_cast<std::intptr_t>(temp)});
+        break;
+      }
+      case T::Exp::Kind::BINOP: {
+        T::BinopExp* binop = static_cast<T::BinopExp*>(exp);
+        int left = valueOf(state, binop->left, memo);
+        int right = valueOf(state, binop->right, memo);
+        if (left < 0 || right < 0) break;
+        if (isCommutative(binop->op) && right < left) std::swap(left, right);
+        v = number({BINOP_KEY, binop->op, left, right});
+        break;
+      }
+      case T::Exp::Kind::MEM: {
+        T::Exp* addr = static_cast<T::MemExp*>(exp)->exp;
+        int a = valueOf(state, addr, memo);
+        if (a >= 0) v = number(loadKey(state, addr, a));
+        break;
+      }
+      case T::Exp::Kind::CALL:
+        for (T::ExpList* l = static_cast<T::CallExp*>(exp)->args; l; l = l->tail)
+          valueOf(state, l->head, memo);
+        break;
+      default:
+        assert(0);
+    }
+    (*memo)[exp] = v;
+    return v;
+  }
+
+  /* A temp that holds v at this point */
+  TEMP::Temp* holding(const State& state, int v) {
+    auto it = holders.find(v);
+    if (it == holders.end()) return nullptr;
+    for (auto h = it->second.rbegin(); h != it->second.rend(); ++h) {
+      auto t = state.temps.find(*h);
+      if (t != state.temps.end() && t->second == v) return *h;
+    }
+    return nullptr;
+  }
+
+  /* Decides, outermost first, which expressions of a statement reuse a
+   * value and which become leaders */
+  void decide(const State& state, T::StmList* cell, T::Exp* exp,
+              const std::map<T::Exp*, int>& memo, std::vector<int>* added) {
+    Occurrence occurrence(cell, exp);
+    if (replaced.count(occurrence) || leaders.count(occurrence)) return;
+    int v = memo.at(exp);
+    bool candidate = v >= 0 && isCandidate(exp);
+    if (candidate) {
+      TEMP::Temp* temp = holding(state, v);
+      auto leader = available.find(v);
+      if (!temp && leader != available.end()) {
+        if (!leader->second->holder)
+          leader->second->holder = TEMP::Temp::NewTemp();
+        temp = leader->second->holder;
+      }
+      if (temp) {
+        replaced[occurrence] = temp;
+        return;
+      }
+    }
+    switch (exp->kind) {
+      case T::Exp::Kind::BINOP:
+        decide(state, cell, static_cast<T::BinopExp*>(exp)->left, memo, added);
+        decide(state, cell, static_cast<T::BinopExp*>(exp)->right, memo, added);
+        break;
+      case T::Exp::Kind::MEM:
+        decide(state, cell, static_cast<T::MemExp*>(exp)->exp, memo, added);
+        break;
+      case T::Exp::Kind::CALL:
+        for (T::ExpList* l = static_cast<T::CallExp*>(exp)->args; l; l = l->tail)
+          decide(state, cell, l->head, memo, added);
+        break;
+      default:
+        break;
+    }
+    if (candidate && !available.count(v)) {
+      Leader* leader = new Leader();
+      leaders[occurrence] = leader;
+      available[v] = leader;
+      added->push_back(v);
+    }
+  }
+
+  void visit(State* state, T::StmList* cell, std::vector<int>* added) {
+    T::Stm* stm = cell->head;
+    std::map<T::Exp*, int> memo;
+    std::vector<T::Exp*> exps;
+    switch (stm->kind) {
+      case T::Stm::Kind::MOVE: {
+        T::MoveStm* move = static_cast<T::MoveStm*>(stm);
+        if (move->dst->kind == T::Exp::Kind::MEM)
+          exps.push_back(static_cast<T::MemExp*>(move->dst)->exp);
+        exps.push_back(move->src);
+        break;
+      }
+      case T::Stm::Kind::EXP:
+        exps.push_back(static_cast<T::ExpStm*>(stm)->exp);
+        break;
+      case T::Stm::Kind::CJUMP:
+        exps.push_back(static_cast<T::CjumpStm*>(stm)->left);
+        exps.push_back(static_cast<T::CjumpStm*>(stm)->right);
+        break;
+      default:
+        return;
+    }
+    for (T::Exp* exp : exps) valueOf(*state, exp, &memo);
+    for (T::Exp* exp : exps) decide(*state, cell, exp, memo, added);
+
+    kill(state, stm);
+    if (stm->kind != T::Stm::Kind::MOVE) return;
+    T::MoveStm* move = static_cast<T::MoveStm*>(stm);
+    int v = memo.at(move->src);
+    if (v < 0) return;
+    if (move->dst->kind == T::Exp::Kind::TEMP) {
+      TEMP::Temp* temp = static_cast<T::TempExp*>(move->dst)->temp;
+      if (temp == F::FP() || OPT::IsRegister(temp)) return;
+      state->temps[temp] = v;
+      holders[v].push_back(temp);
+    } else {
+      // Reading the address back gives the stored value
+      T::Exp* addr = static_cast<T::MemExp*>(move->dst)->exp;
+      int a = memo.at(addr);
+      if (a >= 0) table[loadKey(*state, addr, a)] = v;
+    }
+  }
+};
+
+/* Applies the decisions of a Numbering to one statement. Saving leaders
+ * goes into pre, which runs right before the statement; the statement's
+ * only side effects come after its operands are evaluated. */
+class Rewriter {
+ public:
+  Rewriter(const Numbering& numbering, T::StmList* cell,
+           std::vector<T::Stm*>* pre)
+      : numbering(numbering), cell(cell), pre(pre) {}
+
+  T::Stm* Rewrite(T::Stm* stm) {
+    switch (stm->kind) {
+      case T::Stm::Kind::MOVE: {
+        T::MoveStm* move = static_cast<T::MoveStm*>(stm);
+        T::Exp* dst = move->dst;
+        if (dst->kind == T::Exp::Kind::MEM) {
+          T::Exp* addr = static_cast<T::MemExp*>(dst)->exp;
+          T::Exp* newAddr = Rewrite(addr);
+          if (newAddr != addr) dst = new T::MemExp(newAddr);
+        }
+        T::Exp* src = Rewrite(move->src);
+        if (dst == move->dst && src == move->src) return stm;
+        return new T::MoveStm(dst, src);
+      }
+      case T::Stm::Kind::EXP: {
+        T::Exp* exp = static_cast<T::ExpStm*>(stm)->exp;
+        T::Exp* newExp = Rewrite(exp);
+        return newExp == exp ? stm : new T::ExpStm(newExp);
+      }
+      case T::Stm::Kind::CJUMP: {
+        T::CjumpStm* cjump = static_cast<T::CjumpStm*>(stm);
+        T::Exp* left = Rewrite(cjump->left);
+        T::Exp* right = Rewrite(cjump->right);
+        if (left == cjump->left && right == cjump->right) return stm;
+        return new T::CjumpStm(cjump->op, left, right, cjump->true_label,
+                               cjump->false_label);
+      }
+      default:
+        return stm;
+    }
+  }
+
+ private:
+  const Numbering& numbering;
+  T::StmList* cell;
+  std::vector<T::Stm*>* pre;
+  std::map<T::Exp*, T::Exp*> done;  // trees may share nodes
+
+  T::Exp* Rewrite(T::Exp* exp) {
+    auto it = done.find(exp);
+    if (it != done.end()) return it->second;
+    T::Exp* result = exp;
+    auto replaced = numbering.replaced.find(Occurrence(cell, exp));
+    if (replaced != numbering.replaced.end()) {
+      result = new T::TempExp(replaced->second);
+    } else {
+      switch (exp->kind) {
+        case T::Exp::Kind::BINOP: {
+          T::BinopExp* binop = static_cast<T::BinopExp*>(exp);
+          T::Exp* left = Rewrite(binop->left);
+          T::Exp* right = Rewrite(binop->right);
+          if (left != binop->left || right != binop->right)
+            result = new T::BinopExp(binop->op, left, right);
+          break;
+        }
+        case T::Exp::Kind::MEM: {
+          T::Exp* addr = static_cast<T::MemExp*>(exp)->exp;
+          T::Exp* newAddr = Rewrite(addr);
+          if (newAddr != addr) result = new T::MemExp(newAddr);
+          break;
+        }
+        case T::Exp::Kind::CALL: {
+          T::CallExp* call = static_cast<T::CallExp*>(exp);
+          bool changed = false;
+          std::vector<T::Exp*> args;
+          for (T::ExpList* l = call->args; l; l = l->tail) {
+            args.push_back(Rewrite(l->head));
+            changed = changed || args.back() != l->head;
+          }
+          if (!changed) break;
+          T::ExpList* argList = nullptr;
+          for (int i = args.size() - 1; i >= 0; i--)
+            argList = new T::ExpList(args[i], argList);
+          result = new T::CallExp(call->fun, argList, call->tail);
+          break;
+        }
+        default:
+          break;
+      }
+      auto leader = numbering.leaders.find(Occurrence(cell, exp));
+      if (leader != numbering.leaders.end() && leader->second->holder) {
+        TEMP::Temp* holder = leader->second->holder;
+        pre->push_back(new T::MoveStm(new T::TempExp(holder), result));
+        result = new T::TempExp(holder);
+      }
+    }
+    done[exp] = result;
+    return result;
+  }
+};
+
+bool isSelfMove(T::Stm* stm) {
+  if (stm->kind != T::Stm::Kind::MOVE) return false;
+  T::MoveStm* move = static_cast<T::MoveStm*>(stm);
+  return move->dst->kind == T::Exp::Kind::TEMP &&
+         move->src->kind == T::Exp::Kind::TEMP &&
+         static_cast<T::TempExp*>(move->dst)->temp ==
+             static_cast<T::TempExp*>(move->src)->temp;
+}
+
+}  // namespace
+
+namespace OPT {
+
+C::Block NumberValues(C::Block block) {
+  BlockGraph graph(block);
+  Numbering numbering(graph);
+  numbering.Run();
+  if (numbering.replaced.empty()) return block;
+
+  for (T::StmList* first : graph.blocks) {
+    // Blocks begin with their label, which never changes
+    T::StmList* prev = first;
+    for (T::StmList* cell = first->tail; cell;) {
+      T::StmList* next = cell->tail;
+      std::vector<T::Stm*> pre;
+      T::Stm* stm = Rewriter(numbering, cell, &pre).Rewrite(cell->head);
+      if (isSelfMove(stm) && pre.empty()) {
+        prev->tail = next;
+        cell = next;
+        continue;
+      }
+      if (!isSelfMove(stm)) pre.push_back(stm);
+      cell->head = pre[0];
+      T::StmList* last = cell;
+      for (std::size_t i = 1; i < pre.size(); i++)
+        last = last->tail = new T::StmList(pre[i], nullptr);
+      last->tail = next;
+      prev = last;
+      cell = next;
+    }
+  }
+  return graph.ToBlock();
+}
+
+}  // namespace OPT
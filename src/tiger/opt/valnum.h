@@ -0,0 +1,27 @@
+#ifndef TIGER_OPT_VALNUM_H_
+#define TIGER_OPT_VALNUM_H_
+
+#include "tiger/canon/canon.h"
+
+namespace OPT {
+
+/* Dominator-based value numbering over the canonical basic blocks of one
+ * procedure. Every expression gets a number that only depends on the
+ * values it is built from, so static-link chains, frame slot loads and
+ * address arithmetic rebuilt for each variable access get the same
+ * number as the first time they were computed. When that value is still
+ * held by some temp, or was computed by a statement of a dominating block,
+ * the expression is replaced by a temp holding it.
+ *
+ * Loads are numbered together with the version of the memory they read.
+ * Frame slots of the procedure and of the frames its static links reach
+ * each have their own version, bumped by stores to the slot and by calls;
+ * other memory is bumped by any store to it and by calls. Static-link
+ * slots are only written by the prologue and survive calls. A store also
+ * makes the loaded value of its address known, so reading it back reuses
+ * the stored temp. The result can be handed to C::TraceSchedule. */
+C::Block NumberValues(C::Block block);
+
+}  // namespace OPT
+
+#endif  // TIGER_OPT_VALNUM_H_
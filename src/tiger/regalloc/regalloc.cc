@@ -1,6 +1,9 @@
 #include "tiger/regalloc/regalloc.h"
 #include "tiger/liveness/flowgraph.h"
 #include "tiger/liveness/liveness.h"
+#include "tiger/liveness/loopnest.h"
+#include "tiger/opt/profile.h"
+#include <algorithm>
 #include <vector>
 #include <set>
 #include <map>
@@ -9,11 +12,20 @@
 namespace {
   LIVE::LiveGraph liveGraph;
   std::vector<AS::Instr *> instrVector;
+  FG::Analysis* analysis = nullptr; // Of instrVector, until RewriteProgram
 
   std::map<G::Node<TEMP::Temp>*, int> node2degree;
   std::map<G::Node<TEMP::Temp>*, int> node2color;
   std::map<G::Node<TEMP::Temp>*, G::Node<TEMP::Temp>*> node2alias;
   std::map<G::Node<TEMP::Temp>*, LIVE::MoveList*> node2moveList;
+  std::set<int> calleeSaveColors;
+  std::map<TEMP::Temp*, double> spillCosts; // Filled in by the first SelectSpill of a round
+
+  // Spill code refers to symbolic stack slots until AssignSpillSlots
+  int slotCount = 0;
+  std::map<AS::Instr*, int> slotLoads;
+  std::map<AS::Instr*, int> slotStores;
+  std::set<TEMP::Temp*> spillTemps;
 
   LIVE::MoveList* coalescedMoves = nullptr;
   LIVE::MoveList* constrainedMoves = nullptr;
@@ -36,6 +48,7 @@ namespace {
   std::vector<G::Node<TEMP::Temp> *> toTempVector(G::NodeList<TEMP::Temp>* templist);
   G::NodeList<TEMP::Temp>* toTempList(const std::vector<G::Node<TEMP::Temp> *>& tempVector);
   G::Node<TEMP::Temp>* selectNodeFromSpillWorklist();
+  std::map<TEMP::Temp*, double> SpillCosts();
 
 
   void Build();
@@ -47,6 +60,7 @@ namespace {
   void AssignColors();
   bool MoveRelated(G::Node<TEMP::Temp>* n);
   void RewriteProgram(F::Frame* f);
+  void AssignSpillSlots(F::Frame* f);
   G::NodeList<TEMP::Temp>* Adjacent(G::Node<TEMP::Temp>* n);
   void DecrementDegree(G::Node<TEMP::Temp>* n);
   void FreezeMoves(G::Node<TEMP::Temp>* u);
@@ -76,9 +90,17 @@ Result RegAlloc(F::Frame* f, AS::InstrList* il) {
   Result r;
   bool done = false;
   instrVector = toVector(il);
+  slotCount = 0;
+  slotLoads.clear();
+  slotStores.clear();
+  spillTemps.clear();
+  if (calleeSaveColors.empty()) {
+    for (TEMP::TempList* regs = F::calleesaves(); regs; regs = regs->tail)
+      calleeSaveColors.insert(F::defaultRegisterColor(regs->head));
+  }
   while (!done) {
-    G::Graph<AS::Instr>* flowGraph = FG::AssemFlowGraph(toList(instrVector), f);
-    liveGraph = LIVE::Liveness(flowGraph);
+    analysis = FG::Analyze(f, instrVector);
+    liveGraph = LIVE::Liveness(analysis->flowGraph);
     
     Build();
 
@@ -111,7 +133,10 @@ Result RegAlloc(F::Frame* f, AS::InstrList* il) {
   }
 
   r.coloring = AssignRegisters();
+  AssignSpillSlots(f);
   r.il = toList(instrVector);
+  FG::Invalidate(f); // F_procEntryExit3 goes on to edit r.il
+  analysis = nullptr;
   return r;
 }
 
@@ -153,14 +178,53 @@ namespace {
     return result;
   }
 
+  // Executions of the instructions using or defining each temp, by the
+  // block counts of the profile, or else estimated as 8 per enclosing loop
+  std::map<TEMP::Temp*, double> SpillCosts() {
+    const int MAX_DEPTH = 6;
+    std::map<TEMP::Temp*, double> costs;
+    bool profile = OPT::HaveProfile();
+    double weight = 1;
+    for (std::size_t i = 0; i < instrVector.size(); ++i) {
+      AS::Instr* instr = instrVector[i];
+      if (profile && instr->kind == AS::Instr::Kind::LABEL) {
+        long count = OPT::ProfileCount(OPT::BlockName(static_cast<AS::LabelInstr *>(instr)->label));
+        if (count >= 0)
+          weight = count + 1;
+      }
+      else if (!profile) {
+        weight = 1;
+        for (int depth = std::min(analysis->Depth(i), MAX_DEPTH); depth > 0; --depth)
+          weight *= 8;
+      }
+      for (TEMP::TempList* def = instr->GetDef(); def; def = def->tail)
+        costs[def->head] += weight;
+      for (TEMP::TempList* use = instr->GetUse(); use; use = use->tail)
+        costs[use->head] += weight;
+    }
+    return costs;
+  }
+
+  // Picks the node of highest degree per executed use or def
   G::Node<TEMP::Temp>* selectNodeFromSpillWorklist() {
     std::vector<G::Node<TEMP::Temp> *> tempVector = toTempVector(spillWorklist);
     std::vector<G::Node<TEMP::Temp> *>::iterator target = tempVector.begin();
-    int maxDegree = 0;
+    if (spillCosts.empty())
+      spillCosts = SpillCosts();
+    double maxPriority = 0;
+    bool shortLived = true;
     for (std::vector<G::Node<TEMP::Temp> *>::iterator it = tempVector.begin(); it != tempVector.end(); ++it) {
       G::Node<TEMP::Temp>* node = *it;
-      if (node2degree[node] > maxDegree) {
-        maxDegree = node2degree[node];
+      double priority = node2degree[node] / (spillCosts[node->NodeInfo()] + 1);
+      // Spilling the temps of spill code again gains nothing, avoid them
+      bool isSpillTemp = spillTemps.find(node->NodeInfo()) != spillTemps.end();
+      if (shortLived && !isSpillTemp) {
+        shortLived = false;
+        maxPriority = priority;
+        target = it;
+      }
+      else if (isSpillTemp == shortLived && priority > maxPriority) {
+        maxPriority = priority;
         target = it;
       }
     }
@@ -175,6 +239,7 @@ namespace {
     node2color.clear();
     node2alias.clear();
     node2moveList.clear();
+    spillCosts.clear();
 
     coalescedMoves = nullptr;
     constrainedMoves = nullptr;
@@ -499,7 +564,15 @@ namespace {
       }
       else {
         coloredNodes = new G::NodeList<TEMP::Temp>(n, coloredNodes);
+        // Callee-save registers cost a save and a restore in F_procEntryExit3,
+        // only hand one out when every caller-save register is taken
         int c = *(okColors.begin());
+        for (int color : okColors) {
+          if (calleeSaveColors.find(color) == calleeSaveColors.end()) {
+            c = color;
+            break;
+          }
+        }
         assert(c != -1);
         node2color[n] = c;
       }
@@ -509,46 +582,132 @@ namespace {
       int color = node2color[GetAlias(n)];
       AssertNode(n);
       AssertNode(GetAlias(n));
-      assert(color != -1);
+      // Coalesced into a spilled node: this round is rewritten and redone
+      assert(color != -1 || spilledNodes);
       node2color[n] = color;
     }
   }
 
   void RewriteProgram(F::Frame* f) {
-    std::string fs = f->GetName()->Name() + "_framesize";
+    FG::Invalidate(f);
+    analysis = nullptr;
     for (; spilledNodes; spilledNodes = spilledNodes->tail) {
       G::Node<TEMP::Temp>* nodeToSpill = spilledNodes->head;
-      TEMP::Temp* tempToSpill = nodeToSpill->NodeInfo();
-      assert(!TEMP::inTempList(tempToSpill, F::allocatableRegisters())); // A machine register should never be spilled
-      AS::Instr* spilledInstr = nullptr;
-      F::Access* access = f->AllocLocal(true);
-      int offset = f->GetSize(); // Now the size is the offset of certain variable in frame
-      while ((spilledInstr = findSpilledInstr(instrVector, tempToSpill)) != nullptr) {
-        // We have found an instruction which includes a use of the "tempToSpill"
-        TEMP::Temp* newTemp = TEMP::Temp::NewTemp();
-        TEMP::TempList* def = spilledInstr->GetDef();
-        TEMP::TempList* use = spilledInstr->GetUse();
-
-        if (TEMP::inTempList(tempToSpill, use)) {
-          // This instruction will use the "tempToSpill"
-          std::string assem = "movq (" + fs + "-" + std::to_string(offset) + ")(%rsp), `d0";
-          AS::OperInstr* newInstr = new AS::OperInstr(assem, new TEMP::TempList(newTemp, nullptr), nullptr, new AS::Targets(nullptr));
-          addBefore(instrVector, spilledInstr, newInstr);
-          TEMP::replaceTemps(use, tempToSpill, newTemp); // Replace the spilled temp with the new one
+      // Temps coalesced into the spilled node share its live range and slot
+      std::vector<TEMP::Temp *> tempsToSpill(1, nodeToSpill->NodeInfo());
+      for (G::NodeList<TEMP::Temp>* head = coalescedNodes; head; head = head->tail)
+        if (GetAlias(head->head) == nodeToSpill)
+          tempsToSpill.push_back(head->head->NodeInfo());
+      int slot = slotCount++; // Gets a frame offset in AssignSpillSlots
+      for (TEMP::Temp* tempToSpill : tempsToSpill) {
+        assert(!TEMP::inTempList(tempToSpill, F::allocatableRegisters())); // A machine register should never be spilled
+        AS::Instr* spilledInstr = nullptr;
+        while ((spilledInstr = findSpilledInstr(instrVector, tempToSpill)) != nullptr) {
+          // We have found an instruction which includes a use of the "tempToSpill"
+          TEMP::Temp* newTemp = TEMP::Temp::NewTemp();
+          spillTemps.insert(newTemp);
+          TEMP::TempList* def = spilledInstr->GetDef();
+          TEMP::TempList* use = spilledInstr->GetUse();
+
+          if (TEMP::inTempList(tempToSpill, use)) {
+            // This instruction will use the "tempToSpill"
+            AS::OperInstr* newInstr = new AS::OperInstr("", new TEMP::TempList(newTemp, nullptr), nullptr, new AS::Targets(nullptr));
+            slotLoads[newInstr] = slot;
+            addBefore(instrVector, spilledInstr, newInstr);
+            TEMP::replaceTemps(use, tempToSpill, newTemp); // Replace the spilled temp with the new one
+          }
+
+          if (TEMP::inTempList(tempToSpill, def)) {
+            // This instruction will def the "tempToSpill"
+            AS::OperInstr* newInstr = new AS::OperInstr("", nullptr, new TEMP::TempList(newTemp, nullptr), new AS::Targets(nullptr));
+            slotStores[newInstr] = slot;
+            addAfter(instrVector, spilledInstr, newInstr);
+            TEMP::replaceTemps(def, tempToSpill, newTemp);
+          }
+
+          assert(!TEMP::inTempList(tempToSpill, use) && !TEMP::inTempList(tempToSpill, def));
         }
+      }
+    }
+    assert(!spilledNodes);
+  }
 
-        if (TEMP::inTempList(tempToSpill, def)) {
-          // This instruction will def the "tempToSpill"
-          std::string assem = "movq `s0, (" + fs + "-" + std::to_string(offset) + ")(%rsp)";
-          AS::OperInstr* newInstr = new AS::OperInstr(assem, nullptr, new TEMP::TempList(newTemp, nullptr), new AS::Targets(nullptr));
-          addAfter(instrVector, spilledInstr, newInstr);
-          TEMP::replaceTemps(def, tempToSpill, newTemp);
+  // Spilled temps whose live ranges never overlap share a stack slot. Slot
+  // liveness is computed over the final program like temp liveness, and
+  // the slots are colored greedily; only then is the frame grown.
+  void AssignSpillSlots(F::Frame* f) {
+    if (slotCount == 0)
+      return;
+    std::vector<AS::Instr *>& instrs = instrVector;
+    std::size_t s = instrs.size();
+    // The program is as the last round of coloring analyzed it
+    FG::FlowGraph* flowGraph = FG::Analyze(f, instrs)->flowGraph;
+
+    // Backward dataflow: a load uses its slot, a store defines it
+    std::vector<std::set<int> > in(s), out(s);
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (std::size_t i = s; i-- > 0;) {
+        std::set<int> newOut;
+        for (int succ : flowGraph->Succ(i))
+          newOut.insert(in[succ].begin(), in[succ].end());
+        std::set<int> newIn = newOut;
+        if (slotStores.count(instrs[i]))
+          newIn.erase(slotStores[instrs[i]]);
+        if (slotLoads.count(instrs[i]))
+          newIn.insert(slotLoads[instrs[i]]);
+        if (newIn != in[i] || newOut != out[i]) {
+          in[i] = newIn;
+          out[i] = newOut;
+          changed = true;
         }
+      }
+    }
 
-        assert(!TEMP::inTempList(tempToSpill, use) && !TEMP::inTempList(tempToSpill, def));
+    std::vector<std::set<int> > interfere(slotCount);
+    for (std::size_t i = 0; i < s; ++i) {
+      if (!slotStores.count(instrs[i]))
+        continue;
+      int slot = slotStores[instrs[i]];
+      for (int other : out[i]) {
+        if (other == slot)
+          continue;
+        interfere[slot].insert(other);
+        interfere[other].insert(slot);
       }
     }
-    assert(!spilledNodes);
+    // Slots read before any store (only on paths that never run) overlap
+    for (int a : in[0])
+      for (int b : in[0])
+        if (a != b)
+          interfere[a].insert(b);
+
+    std::vector<int> slotColor(slotCount, -1);
+    std::vector<int> colorOffset;
+    for (int slot = 0; slot < slotCount; ++slot) {
+      std::set<int> taken;
+      for (int other : interfere[slot])
+        taken.insert(slotColor[other]);
+      int color = 0;
+      while (taken.count(color))
+        color++;
+      if (color == (int)colorOffset.size()) {
+        f->AllocLocal(true);
+        colorOffset.push_back(f->GetSize()); // Now the size is the offset of the new slot
+      }
+      slotColor[slot] = color;
+    }
+
+    std::string fs = f->GetName()->Name() + "_framesize";
+    for (const std::pair<AS::Instr* const, int>& load : slotLoads) {
+      std::string offset = std::to_string(colorOffset[slotColor[load.second]]);
+      static_cast<AS::OperInstr *>(load.first)->assem = "movq (" + fs + "-" + offset + ")(%rsp), `d0";
+    }
+    for (const std::pair<AS::Instr* const, int>& store : slotStores) {
+      std::string offset = std::to_string(colorOffset[slotColor[store.second]]);
+      static_cast<AS::OperInstr *>(store.first)->assem = "movq `s0, (" + fs + "-" + offset + ")(%rsp)";
+    }
   }
 
   void addBefore(std::vector<AS::Instr *>& iVector, AS::Instr* pos, AS::Instr* newInstr) {
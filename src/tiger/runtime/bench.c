@@ -0,0 +1,106 @@
+/*
+ * Micro-benchmarks for the runtime primitives. The runtime calls
+ * tigermain() once it is set up, so this file stands in for a compiled
+ * Tiger program:
+ *
+ *   gcc -O2 src/tiger/runtime/bench.c src/tiger/runtime/runtime.c -o bench
+ *   ./bench > /dev/null
+ *
+ * Timings go to stderr. Run with TIGER_NO_AVX2=1 to time the SSE2 kernels
+ * or with TIGER_INTERN=1 to time the intern table, and add
+ * -DTIGER_UNLOCKED_STDIO to time the unlocked output mode, or
+ * -DTIGER_ALLOC_PROFILE to see the allocation profile. The stdio rows
+ * do what print and printi used to do, for comparison.
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+struct string;
+
+extern struct string *chr(int i);
+extern struct string *concat(struct string *a, struct string *b, long site);
+extern struct string *substring(struct string *s, int first, int n);
+extern int ord(struct string *s);
+extern int stringEqual(struct string *s, struct string *t);
+extern long *initArray(int size, long init, int pointers, long site);
+extern void print(struct string *s);
+extern void printi(int k);
+extern void flush();
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void report(const char *name, long iterations, double start) {
+  fprintf(stderr, "%-16s %10.1f ns/op\n", name,
+          (now() - start) * 1e9 / iterations);
+}
+
+/* 2^k copies of the character c */
+static struct string *repeat(int c, int k) {
+  struct string *s = chr(c);
+  while (k-- > 0) s = concat(s, s, 0);
+  return s;
+}
+
+int tigermain(long staticLink) {
+  struct string *a = repeat('a', 12), *b = repeat('a', 12), *c;
+  volatile long sink = 0;
+  long i, n = 100000;
+  double start;
+
+  start = now();
+  for (i = 0; i < n; i++) sink += stringEqual(a, b);
+  report("stringEqual", n, start);
+
+  c = concat(substring(a, 0, 4095), chr('b'), 0);
+  start = now();
+  for (i = 0; i < n; i++) sink += stringEqual(a, c);
+  report("stringEqual/ne", n, start);
+
+  start = now();
+  for (i = 0; i < n; i++) sink += (long)concat(a, b, 0);
+  report("concat", n, start);
+
+  start = now();
+  for (c = chr('a'), i = 0; i < n; i++) c = concat(c, chr('b'), 0);
+  sink += ord(c);
+  report("append", n, start);
+
+  start = now();
+  for (i = 0; i < n; i++) sink += (long)substring(a, 1, 2048);
+  report("substring", n, start);
+
+  start = now();
+  for (i = 0; i < n; i++) sink += (long)initArray(1024, i, 0, 0);
+  report("initArray", n, start);
+
+  start = now();
+  for (i = 0; i < n; i++) print(a);
+  flush();
+  report("print", n, start);
+
+  start = now();
+  for (i = 0; i < n; i++) {
+    int j;
+    for (j = 0; j < 4096; j++) putchar('a');
+  }
+  fflush(stdout);
+  report("stdio print", n, start);
+
+  n = 10000000;
+  start = now();
+  for (i = 0; i < n; i++) printi(i - n / 2);
+  flush();
+  report("printi", n, start);
+
+  start = now();
+  for (i = 0; i < n; i++) printf("%d", (int)(i - n / 2));
+  fflush(stdout);
+  report("stdio printi", n, start);
+
+  return (int)(sink & 0);
+}
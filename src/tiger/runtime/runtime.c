@@ -1,61 +1,717 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <immintrin.h>
 
 extern int tigermain();
 
-long *initArray(int size, int init) {
-  int i;
-  long *a = (long *)malloc(size * sizeof(long));
-  for (i = 0; i < size; i++) a[i] = init;
-  return a;
+/*
+ * SIMD kernels
+ *
+ * SSE2 is part of x86-64, the AVX2 variants are compiled for that target
+ * only and picked by select_kernels() when cpuid reports them. Set
+ * TIGER_NO_AVX2 in the environment to keep the SSE2 ones.
+ */
+
+static int bytes_equal_sse2(const unsigned char *a, const unsigned char *b, long n) {
+  long i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+    __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xffff) return 0;
+  }
+  return memcmp(a + i, b + i, n - i) == 0;
 }
 
-int *allocRecord(int size) {
-  int i;
-  int *p, *a;
-  p = a = (int *)malloc(size);
-  for (i = 0; i < size; i += sizeof(int)) *p++ = 0;
+__attribute__((target("avx2")))
+static int bytes_equal_avx2(const unsigned char *a, const unsigned char *b, long n) {
+  long i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+    __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)) != -1) return 0;
+  }
+  return bytes_equal_sse2(a + i, b + i, n - i);
+}
+
+static void fill_words_sse2(long *p, long v, long n) {
+  __m128i x = _mm_set1_epi64x(v);
+  long i = 0;
+  for (; i + 2 <= n; i += 2) _mm_storeu_si128((__m128i *)(p + i), x);
+  if (i < n) p[i] = v;
+}
+
+__attribute__((target("avx2")))
+static void fill_words_avx2(long *p, long v, long n) {
+  __m256i x = _mm256_set1_epi64x(v);
+  long i = 0;
+  for (; i + 4 <= n; i += 4) _mm256_storeu_si256((__m256i *)(p + i), x);
+  fill_words_sse2(p + i, v, n - i);
+}
+
+static int (*bytes_equal)(const unsigned char *, const unsigned char *, long) = bytes_equal_sse2;
+static void (*fill_words)(long *, long, long) = fill_words_sse2;
+
+static void select_kernels(void) {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && !getenv("TIGER_NO_AVX2")) {
+    bytes_equal = bytes_equal_avx2;
+    fill_words = fill_words_avx2;
+  }
+}
+
+/*
+ * Garbage collector
+ *
+ * A mostly-copying collector (Bartlett). The heap is a reserved range of
+ * pages grouped into blocks; objects are bump-allocated inside a block
+ * and never cross its end, objects larger than a page get a block of
+ * their own. Every object has a two word header right before the data
+ * Tiger code points to:
+ *
+ *   p[-2]  descriptor: a record descriptor emitted by the compiler
+ *          (8-aligned), one of the odd DESC_* tags below, or the new
+ *          address | FORWARDED once the object has been copied
+ *   p[-1]  size of the data in words (the length of an array)
+ *
+ * Temps carry no type after register allocation, so the stack and the
+ * callee-save registers are scanned conservatively: a block referenced
+ * from there is promoted in place, which also keeps pointers derived by
+ * the loop optimizer valid. Everything reachable only from the heap is
+ * found precisely through the descriptors and copied, Cheney style.
+ *
+ * Compiled code allocates records inline by bumping tiger_heap_ptr and
+ * only calls allocRecord once it would pass tiger_heap_limit.
+ *
+ * Set TIGER_GC_STRESS in the environment to collect on every allocation.
+ */
+
+#define PAGE_SHIFT 12
+#define PAGE_SIZE (1L << PAGE_SHIFT)
+#define HEAP_PAGES (1L << 18) /* 1GB reserved, touched on demand */
+#define MIN_HEAP_PAGES 256
+
+#define DESC_RAW_ARRAY 1L
+#define DESC_PTR_ARRAY 3L
+#define DESC_STRING 5L
+#define FORWARDED 2L
+
+/* Emitted per record type by the translator (Layout in translate.cc).
+ * Every field takes a word, and words [first_pointer, first_pointer +
+ * pointers) are the ones holding pointers. */
+struct record_desc {
+  long nfields;
+  long type_id; /* 1, 2, ... in the order the compiler met the types */
+  long first_pointer;
+  long pointers;
+};
+
+/* Bump pointer of the current allocation block and the limit compiled
+ * code checks it against, which is alloc_limit unless collections are
+ * forced on every allocation */
+long *tiger_heap_ptr, *tiger_heap_limit;
+static long *alloc_limit;
+
+static char *heap;
+static int space_of[HEAP_PAGES];  /* 0: free */
+static int block_of[HEAP_PAGES];  /* first page of the enclosing block */
+static int pages_of[HEAP_PAGES];  /* block length, on its first page */
+static long used_of[HEAP_PAGES];  /* bytes allocated, on its first page */
+static long heap_top, rover, pages_in_use, gc_threshold = MIN_HEAP_PAGES;
+static long peak_pages, collections;
+static int current_space = 1, gc_stress;
+static long alloc_block = -1;
+static long *stack_bottom;
+
+/* State of a collection */
+static int from_space;
+static long copy_block = -1;
+static long *copy_ptr, *copy_limit;
+static long *queue, queue_len, queue_cap;
+
+static void gc_collect(void);
+static void intern_sweep(void);
+
+static char *page_addr(long page) { return heap + (page << PAGE_SHIFT); }
+
+static long page_index(long addr) {
+  if (!heap || addr < (long)heap || addr >= (long)(heap + (heap_top << PAGE_SHIFT)))
+    return -1;
+  return (addr - (long)heap) >> PAGE_SHIFT;
+}
+
+static long object_words(long *obj) { return 2 + obj[1]; }
+
+static long find_free_pages(long n) {
+  long start, len = 0, i;
+  for (i = rover; i < heap_top; i++) {
+    len = space_of[i] ? 0 : len + 1;
+    if (len == n) return i - n + 1;
+  }
+  for (i = 0, len = 0; i < rover && i < heap_top; i++) {
+    len = space_of[i] ? 0 : len + 1;
+    if (len == n) return i - n + 1;
+  }
+  /* Grow into untouched pages, reusing a free run at the top */
+  for (start = heap_top; start > 0 && !space_of[start - 1]; start--)
+    ;
+  if (start + n > HEAP_PAGES) {
+    fprintf(stderr, "tiger: out of memory\n");
+    exit(1);
+  }
+  if (start + n > heap_top) heap_top = start + n;
+  return start;
+}
+
+static long new_block(long npages, int space) {
+  long b = find_free_pages(npages), i;
+  for (i = 0; i < npages; i++) {
+    space_of[b + i] = space;
+    block_of[b + i] = b;
+  }
+  pages_of[b] = npages;
+  used_of[b] = 0;
+  pages_in_use += npages;
+  if (pages_in_use > peak_pages) peak_pages = pages_in_use;
+  rover = b + npages;
+  return b;
+}
+
+static void close_block(long b, long *ptr) {
+  if (b >= 0) used_of[b] = (char *)ptr - page_addr(b);
+}
+
+static void gc_init(void) {
+  heap = mmap(NULL, HEAP_PAGES << PAGE_SHIFT, PROT_READ | PROT_WRITE,
+              MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (heap == MAP_FAILED) {
+    fprintf(stderr, "tiger: cannot reserve the heap\n");
+    exit(1);
+  }
+  gc_stress = getenv("TIGER_GC_STRESS") != NULL;
+}
+
+/* Returns uninitialized data of the given size, preceded by its header.
+ * Callers fill in every word before anything else is allocated. */
+static long *gc_alloc(long desc, long words) {
+  long bytes = (2 + words) * sizeof(long);
+  long *obj;
+  if (gc_stress) gc_collect();
+  if (bytes > PAGE_SIZE) {
+    long npages = (bytes + PAGE_SIZE - 1) >> PAGE_SHIFT, b;
+    if (pages_in_use + npages > gc_threshold) gc_collect();
+    b = new_block(npages, current_space);
+    used_of[b] = bytes;
+    obj = (long *)page_addr(b);
+  } else {
+    if (tiger_heap_ptr + 2 + words > alloc_limit) {
+      close_block(alloc_block, tiger_heap_ptr);
+      if (pages_in_use + 1 > gc_threshold) gc_collect();
+      if (tiger_heap_ptr + 2 + words > alloc_limit) {
+        alloc_block = new_block(1, current_space);
+        tiger_heap_ptr = (long *)page_addr(alloc_block);
+        alloc_limit = (long *)page_addr(alloc_block + 1);
+      }
+    }
+    obj = tiger_heap_ptr;
+    tiger_heap_ptr += 2 + words;
+  }
+  tiger_heap_limit = gc_stress ? tiger_heap_ptr : alloc_limit;
+  obj[0] = desc;
+  obj[1] = words;
+  return obj + 2;
+}
+
+static void enqueue(long b) {
+  if (queue_len == queue_cap) {
+    queue_cap = queue_cap ? 2 * queue_cap : 64;
+    queue = realloc(queue, queue_cap * sizeof(long));
+  }
+  queue[queue_len++] = b;
+}
+
+static void promote(long b) {
+  long i;
+  if (space_of[b] != from_space) return;
+  for (i = 0; i < pages_of[b]; i++) space_of[b + i] = current_space;
+  enqueue(b);
+}
+
+static long *copy_words(long words) {
+  if (copy_ptr + words > copy_limit) {
+    close_block(copy_block, copy_ptr);
+    copy_block = new_block(1, current_space);
+    copy_ptr = (long *)page_addr(copy_block);
+    copy_limit = (long *)page_addr(copy_block + 1);
+    enqueue(copy_block);
+  }
+  copy_ptr += words;
+  return copy_ptr - words;
+}
+
+/* Like forward, but for a weak reference: 0 once the object is dead */
+static long forward_weak(long v) {
+  long page = page_index(v - sizeof(long)), *obj;
+  if (page < 0 || space_of[block_of[page]] != from_space) return v;
+  obj = (long *)v - 2;
+  return (obj[0] & 3) == FORWARDED ? obj[0] & ~3L : 0;
+}
+
+/* Returns the new location of the object v points to */
+static long forward(long v) {
+  long page = page_index(v - sizeof(long)), b, words; /* by its header */
+  long *obj, *copy;
+  if (page < 0) return v;
+  b = block_of[page];
+  if (space_of[b] != from_space) return v;
+  obj = (long *)v - 2;
+  if ((obj[0] & 3) == FORWARDED) return obj[0] & ~3L;
+  if (pages_of[b] > 1) {
+    promote(b); /* large objects are never copied */
+    return v;
+  }
+  words = object_words(obj);
+  copy = copy_words(words);
+  memcpy(copy, obj, words * sizeof(long));
+  obj[0] = (long)(copy + 2) | FORWARDED;
+  return (long)(copy + 2);
+}
+
+static void scan_object(long *obj) {
+  long *data = obj + 2, i;
+  if (obj[0] == DESC_PTR_ARRAY) {
+    for (i = 0; i < obj[1]; i++) data[i] = forward(data[i]);
+  } else if (!(obj[0] & 1)) {
+    struct record_desc *desc = (struct record_desc *)obj[0];
+    long end = desc->first_pointer + desc->pointers;
+    for (i = desc->first_pointer; i < end; i++) data[i] = forward(data[i]);
+  }
+}
+
+static void scan_roots(long *sp) {
+  long *p, page;
+  for (p = sp; p < stack_bottom; p++) {
+    /* One past the end of an object still keeps that object alive */
+    if ((page = page_index(*p)) >= 0) promote(block_of[page]);
+    if ((page = page_index(*p - 1)) >= 0) promote(block_of[page]);
+  }
+}
+
+static void __attribute__((noinline)) gc_collect_from_here(void) {
+  long marker = 0, i, *p, *end;
+  from_space = current_space++;
+  collections++;
+  close_block(alloc_block, tiger_heap_ptr);
+  alloc_block = -1;
+  tiger_heap_ptr = alloc_limit = NULL;
+  copy_block = -1;
+  copy_ptr = copy_limit = NULL;
+  queue_len = 0;
+
+  scan_roots(&marker);
+  for (i = 0; i < queue_len; i++) {
+    long b = queue[i];
+    p = (long *)page_addr(b);
+    for (;;) {
+      end = b == copy_block ? copy_ptr : (long *)(page_addr(b) + used_of[b]);
+      if (p >= end) break;
+      scan_object(p);
+      p += object_words(p);
+    }
+  }
+  close_block(copy_block, copy_ptr);
+  intern_sweep();
+
+  for (i = 0; i < heap_top; i++)
+    if (space_of[i] == from_space) {
+      space_of[i] = 0;
+      block_of[i] = i;
+      pages_in_use--;
+    }
+  gc_threshold = 2 * pages_in_use > MIN_HEAP_PAGES ? 2 * pages_in_use : MIN_HEAP_PAGES;
+  rover = 0;
+
+  /* Keep allocating after the copies */
+  alloc_block = copy_block;
+  tiger_heap_ptr = copy_ptr;
+  alloc_limit = copy_limit;
+}
+
+static void __attribute__((noinline)) gc_collect(void) {
+  __builtin_unwind_init(); /* spill callee-save registers onto the stack */
+  gc_collect_from_here();
+}
+
+/*
+ * Allocation profile
+ *
+ * Compiled with -DTIGER_ALLOC_PROFILE, the runtime counts the bytes
+ * allocated by kind and by call site and reports them on stderr at exit,
+ * along with collections and the peak heap size. Link that build instead
+ * of the normal one. The site is the last argument of allocRecord,
+ * initArray and concat: a program compiled with --alloc-profile passes
+ * an index into its tiger_alloc_sites table, other programs pass nothing
+ * meaningful and everything lands in one unknown site. Allocations the
+ * runtime makes for itself (substring, flattening ropes) are not counted.
+ *
+ * Set TIGER_ALLOC_SAMPLE=N to update the site table on every Nth
+ * allocation only, scaling what it records by N. The totals by kind
+ * stay exact.
+ */
+
+#ifdef TIGER_ALLOC_PROFILE
+
+enum { KIND_RECORD, KIND_ARRAY, KIND_STRING, KINDS };
+
+static const char *kind_names[KINDS] = {"record", "array", "string"};
+
+struct site_stats {
+  long count, bytes;
+};
+
+extern const char *tiger_alloc_sites[] __attribute__((weak));
+
+static struct site_stats *sites; /* sites[nsites] collects unknown ones */
+static long nsites;
+static long kind_count[KINDS], kind_bytes[KINDS];
+static long sample_period = 1, sample_left = 1;
+
+static void profile_alloc(long site, int kind, long words) {
+  long bytes = (2 + words) * sizeof(long);
+  kind_count[kind]++;
+  kind_bytes[kind] += bytes;
+  if (--sample_left) return;
+  sample_left = sample_period;
+  if (site < 0 || site >= nsites) site = nsites;
+  sites[site].count += sample_period;
+  sites[site].bytes += bytes * sample_period;
+}
+
+static int by_bytes(const void *a, const void *b) {
+  long x = sites[*(const long *)a].bytes, y = sites[*(const long *)b].bytes;
+  return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static void profile_report(void) {
+  long *order = malloc((nsites + 1) * sizeof(long)), i;
+  fprintf(stderr, "tiger: allocation profile");
+  if (sample_period > 1) fprintf(stderr, ", sites sampled 1 in %ld", sample_period);
+  fprintf(stderr, "\n%-8s %12s %14s\n", "kind", "count", "bytes");
+  for (i = 0; i < KINDS; i++)
+    fprintf(stderr, "%-8s %12ld %14ld\n", kind_names[i], kind_count[i], kind_bytes[i]);
+  fprintf(stderr, "%ld collections, peak heap %ld KB\n", collections,
+          peak_pages << (PAGE_SHIFT - 10));
+  for (i = 0; i <= nsites; i++) order[i] = i;
+  qsort(order, nsites + 1, sizeof(long), by_bytes);
+  fprintf(stderr, "%12s %14s  site\n", "count", "bytes");
+  for (i = 0; i <= nsites && sites[order[i]].count; i++)
+    fprintf(stderr, "%12ld %14ld  %s\n", sites[order[i]].count, sites[order[i]].bytes,
+            order[i] < nsites ? tiger_alloc_sites[order[i]] : "unknown");
+  free(order);
+}
+
+static void profile_init(void) {
+  const char *period = getenv("TIGER_ALLOC_SAMPLE");
+  if (tiger_alloc_sites)
+    while (tiger_alloc_sites[nsites]) nsites++;
+  sites = calloc(nsites + 1, sizeof(struct site_stats));
+  if (period && atol(period) > 1) sample_period = sample_left = atol(period);
+  atexit(profile_report);
+}
+
+#define PROFILE_ALLOC(site, kind, words) profile_alloc(site, kind, words)
+
+#else
+
+#define PROFILE_ALLOC(site, kind, words) ((void)(site))
+
+#endif
+
+long *initArray(int size, long init, int pointers, long site) {
+  long *a;
+  if (size < 0) size = 0;
+  PROFILE_ALLOC(site, KIND_ARRAY, size);
+  a = gc_alloc(pointers ? DESC_PTR_ARRAY : DESC_RAW_ARRAY, size);
+  fill_words(a, init, size);
   return a;
 }
 
+long *allocRecord(struct record_desc *desc, long site) {
+  long *r;
+  PROFILE_ALLOC(site, KIND_RECORD, desc->nfields);
+  r = gc_alloc((long)desc, desc->nfields);
+  fill_words(r, 0, desc->nfields);
+  return r;
+}
+
+/* Literals are emitted by do_str in main.cc with their hash filled in,
+ * other strings compute it the first time it is needed */
 struct string {
   int length;
+  unsigned int hash; /* 0 until known */
   unsigned char chars[1];
 };
 
+static struct string *allocString(int length) {
+  long words = (2 * sizeof(int) + length + sizeof(long) - 1) / sizeof(long);
+  struct string *s = (struct string *)gc_alloc(DESC_STRING, words);
+  s->length = length;
+  s->hash = 0;
+  return s;
+}
+
+/*
+ * Ropes
+ *
+ * concat builds a rope node instead of copying once the result has
+ * ROPE_MIN characters. A node is a record with a negated length followed
+ * by the two operands, allocated with rope_desc so the collector traces
+ * them. flat() copies the characters out the first time they are needed
+ * and keeps the copy in the node, so repeated s := concat(s, x) stays
+ * linear. Literals and other flat strings keep the layout do_str emits.
+ */
+
+#define ROPE_MIN 64
+
+struct rope {
+  int length; /* -(total length) */
+  unsigned int hash;
+  struct string *left;
+  struct string *right; /* NULL once left holds the flat copy */
+};
+
+static struct record_desc rope_desc = {3, 0, 1, 2}; /* left and right */
+
+static int string_length(struct string *s) {
+  return s->length < 0 ? -s->length : s->length;
+}
+
+static struct string *flat(struct string *s) {
+  struct rope *r = (struct rope *)s;
+  struct string *t, *x, **stack;
+  long top = 0, cap = 64, pos = 0;
+  if (s->length >= 0) return s;
+  if (!r->right) return r->left;
+  t = allocString(-s->length); /* s is on the stack, so it stays put */
+  stack = malloc(cap * sizeof(struct string *));
+  stack[top++] = s;
+  while (top) {
+    x = stack[--top];
+    r = (struct rope *)x;
+    if (x->length < 0 && !r->right) x = r->left;
+    if (x->length >= 0) {
+      memcpy(t->chars + pos, x->chars, x->length);
+      pos += x->length;
+      continue;
+    }
+    if (top + 2 > cap) stack = realloc(stack, (cap *= 2) * sizeof(struct string *));
+    stack[top++] = r->right;
+    stack[top++] = r->left;
+  }
+  free(stack);
+  r = (struct rope *)s;
+  r->left = t;
+  r->right = NULL;
+  return t;
+}
+
+/* FNV-1a, as in main.cc */
+static unsigned int string_hash(struct string *s) {
+  if (!s->hash) {
+    unsigned int hash = 2166136261u;
+    int i;
+    for (i = 0; i < s->length; i++) hash = (hash ^ s->chars[i]) * 16777619u;
+    s->hash = hash ? hash : 1;
+  }
+  return s->hash;
+}
+
 int stringEqual(struct string *s, struct string *t) {
-  int i;
   if (s == t) return 1;
-  if (s->length != t->length) return 0;
-  for (i = 0; i < s->length; i++)
-    if (s->chars[i] != t->chars[i]) return 0;
-  return 1;
+  if (string_length(s) != string_length(t)) return 0;
+  s = flat(s);
+  t = flat(t);
+  if (s == t) return 1;
+  if (string_hash(s) != string_hash(t)) return 0;
+  return bytes_equal(s->chars, t->chars, s->length);
+}
+
+/*
+ * Intern table
+ *
+ * With TIGER_INTERN set, the literals of the program and the results of
+ * concat and substring are looked up in an open addressing table, so
+ * equal strings mostly share one object and stringEqual stops at s == t.
+ * The table holds heap strings weakly: intern_sweep drops the dead ones
+ * and moves the copied ones after every collection.
+ */
+
+extern struct string *tiger_literals[] __attribute__((weak));
+
+static struct string **intern_table;
+static long intern_cap, intern_count;
+static int intern_strings;
+
+static void intern_add(struct string *s) {
+  long i;
+  if (2 * (intern_count + 1) > intern_cap) {
+    struct string **old = intern_table;
+    long cap = intern_cap;
+    intern_cap = cap ? 2 * cap : 1024;
+    intern_table = calloc(intern_cap, sizeof(struct string *));
+    intern_count = 0;
+    for (i = 0; i < cap; i++)
+      if (old[i]) intern_add(old[i]);
+    free(old);
+  }
+  i = string_hash(s) & (intern_cap - 1);
+  while (intern_table[i]) i = (i + 1) & (intern_cap - 1);
+  intern_table[i] = s;
+  intern_count++;
+}
+
+static struct string *intern(struct string *s) {
+  long i = string_hash(s) & (intern_cap - 1);
+  struct string *t;
+  for (; (t = intern_table[i]); i = (i + 1) & (intern_cap - 1))
+    if (t->hash == s->hash && t->length == s->length &&
+        bytes_equal(t->chars, s->chars, s->length))
+      return t;
+  intern_add(s);
+  return s;
+}
+
+static void intern_sweep(void) {
+  struct string **old = intern_table;
+  long cap = intern_cap, i, v;
+  if (!intern_strings) return;
+  intern_table = calloc(cap, sizeof(struct string *));
+  intern_count = 0;
+  for (i = 0; i < cap; i++)
+    if (old[i] && (v = forward_weak((long)old[i]))) intern_add((struct string *)v);
+  free(old);
+}
+
+/*
+ * Output
+ *
+ * print and printi append to a buffer owned by the runtime, which goes
+ * to stdout when it fills, on flush(), before reading input, before an
+ * error message and at exit. Compile with -DTIGER_UNLOCKED_STDIO for the
+ * unlocked stdio calls, only safe while the program is single-threaded.
+ */
+
+#ifdef TIGER_UNLOCKED_STDIO
+#define out_write fwrite_unlocked
+#define out_fflush fflush_unlocked
+#define in_getc getc_unlocked
+#else
+#define out_write fwrite
+#define out_fflush fflush
+#define in_getc getc
+#endif
+
+#define OUT_BUF_SIZE 65536
+
+static char out_buf[OUT_BUF_SIZE];
+static long out_len;
+
+static void out_flush(void) {
+  if (out_len) out_write(out_buf, 1, out_len, stdout);
+  out_len = 0;
+  out_fflush(stdout);
 }
 
 void print(struct string *s) {
-  int i;
-  unsigned char *p = s->chars;
-  for (i = 0; i < s->length; i++, p++) putchar(*p);
+  s = flat(s);
+  if (out_len + s->length > OUT_BUF_SIZE) {
+    out_flush();
+    if (s->length > OUT_BUF_SIZE) {
+      out_write(s->chars, 1, s->length, stdout);
+      return;
+    }
+  }
+  memcpy(out_buf + out_len, s->chars, s->length);
+  out_len += s->length;
 }
 
-void printi(int k) { printf("%d", k); }
+void printi(int k) {
+  char digits[12], *p = digits + sizeof(digits);
+  unsigned long u = k < 0 ? -(long)k : k;
+  do {
+    *--p = '0' + u % 10;
+    u /= 10;
+  } while (u);
+  if (k < 0) *--p = '-';
+  if (out_len + (digits + sizeof(digits) - p) > OUT_BUF_SIZE) out_flush();
+  memcpy(out_buf + out_len, p, digits + sizeof(digits) - p);
+  out_len += digits + sizeof(digits) - p;
+}
+
+void flush() { out_flush(); }
+
+/*
+ * Execution profile
+ *
+ * A program compiled with --profile has a counter per function, and per
+ * block with --profile-blocks, named in tiger_profile_names. At exit
+ * they are written to $TIGER_PROFILE, or tiger.prof, one "count name"
+ * line each, for the compiler's --profile-use. Profiles of several runs
+ * can be concatenated, the compiler adds up the counts.
+ */
+
+extern const char *tiger_profile_names[] __attribute__((weak));
+extern long tiger_profile_counts[] __attribute__((weak));
 
-void flush() { fflush(stdout); }
+static void profile_dump(void) {
+  const char *name = getenv("TIGER_PROFILE");
+  FILE *f = fopen(name ? name : "tiger.prof", "w");
+  long i;
+  if (!f) {
+    fprintf(stderr, "tiger: cannot write %s\n", name ? name : "tiger.prof");
+    return;
+  }
+  fprintf(f, "# tiger profile\n");
+  for (i = 0; tiger_profile_names[i]; i++)
+    fprintf(f, "%ld %s\n", tiger_profile_counts[i], tiger_profile_names[i]);
+  fclose(f);
+}
 
 struct string consts[256];
-struct string empty = {0, ""};
+struct string empty = {0, 0, ""};
+
+static void intern_init(void) {
+  struct string **literal;
+  int i;
+  intern_strings = getenv("TIGER_INTERN") != NULL;
+  if (!intern_strings) return;
+  intern_add(&empty);
+  for (i = 0; i < 256; i++) intern_add(consts + i);
+  if (tiger_literals)
+    for (literal = tiger_literals; *literal; literal++) intern(*literal);
+}
 
 int main() {
   int i;
+  stack_bottom = (long *)__builtin_frame_address(0);
+  gc_init();
+  select_kernels();
+  atexit(out_flush);
+#ifdef TIGER_ALLOC_PROFILE
+  profile_init();
+#endif
+  if (tiger_profile_names) atexit(profile_dump);
   for (i = 0; i < 256; i++) {
     consts[i].length = 1;
     consts[i].chars[0] = i;
   }
+  intern_init();
   return tigermain(0 /* static link */);
 }
 
 int ord(struct string *s) {
+  s = flat(s);
   if (s->length == 0)
     return -1;
   else
@@ -64,50 +720,71 @@ int ord(struct string *s) {
 
 struct string *chr(int i) {
   if (i < 0 || i >= 256) {
+    out_flush();
     printf("chr(%d) out of range\n", i);
     exit(1);
   }
   return consts + i;
 }
 
-int size(struct string *s) { return s->length; }
+int size(struct string *s) { return string_length(s); }
 
 struct string *substring(struct string *s, int first, int n) {
+  s = flat(s);
   if (first < 0 || first + n > s->length) {
+    out_flush();
     printf("substring([%d],%d,%d) out of range\n", s->length, first, n);
     exit(1);
   }
   if (n == 1) return consts + s->chars[first];
   {
-    struct string *t = (struct string *)malloc(sizeof(int) + n);
-    int i;
-    t->length = n;
-    for (i = 0; i < n; i++) t->chars[i] = s->chars[first + i];
-    return t;
+    struct string *t = allocString(n);
+    memcpy(t->chars, s->chars + first, n);
+    return intern_strings ? intern(t) : t;
   }
 }
 
-struct string *concat(struct string *a, struct string *b) {
+struct string *concat(struct string *a, struct string *b, long site) {
+  int n = string_length(a) + string_length(b);
   if (a->length == 0)
     return b;
   else if (b->length == 0)
     return a;
-  else {
-    int i, n = a->length + b->length;
-    struct string *t = (struct string *)malloc(sizeof(int) + n);
-    t->length = n;
-    for (i = 0; i < a->length; i++) t->chars[i] = a->chars[i];
-    for (i = 0; i < b->length; i++) t->chars[i + a->length] = b->chars[i];
-    return t;
+  else if (n >= ROPE_MIN && !intern_strings) {
+    struct rope *r;
+    PROFILE_ALLOC(site, KIND_STRING, 3);
+    r = (struct rope *)gc_alloc((long)&rope_desc, 3);
+    r->length = -n;
+    r->hash = 0;
+    r->left = a;
+    r->right = b;
+    return (struct string *)r;
+  } else {
+    struct string *t;
+    a = flat(a);
+    b = flat(b);
+    PROFILE_ALLOC(site, KIND_STRING, (2 * sizeof(int) + n + sizeof(long) - 1) / sizeof(long));
+    t = allocString(n);
+    memcpy(t->chars, a->chars, a->length);
+    memcpy(t->chars + a->length, b->chars, b->length);
+    return intern_strings ? intern(t) : t;
   }
 }
 
+void boundsError(long index, long size) {
+  out_flush();
+  printf("array index %ld out of range [0,%ld)\n", index, size);
+  exit(1);
+}
+
 int not(int i) { return !i; }
 
 #undef getchar
 
 struct string *__wrap_getchar() {
-  int i = getc(stdin);
+  int i;
+  if (out_len) out_flush();
+  i = in_getc(stdin);
   if (i == EOF)
     return &empty;
   else
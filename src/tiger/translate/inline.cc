@@ -0,0 +1,303 @@
+#include "tiger/translate/inline.h"
+
+#include <cstdio>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "tiger/errormsg/errormsg.h"
+#include "tiger/util/options.h"
+
+extern EM::ErrorMsg errormsg;
+
+namespace {
+
+class Candidate {
+ public:
+  std::string name;
+  T::Exp* body;
+  std::vector<TEMP::Temp*> formals;
+  int size;
+  bool usesStaticLink;
+};
+
+std::map<TEMP::Label*, Candidate> candidates;
+
+bool isRegister(TEMP::Temp* temp) {
+  return TEMP::inTempList(temp, F::registers());
+}
+
+/* MEM(FP - wordSize), the only way an inlinable body may mention FP */
+bool isStaticLink(T::Exp* exp) {
+  if (exp->kind != T::Exp::Kind::MEM) return false;
+  T::Exp* addr = static_cast<T::MemExp*>(exp)->exp;
+  if (addr->kind != T::Exp::Kind::BINOP) return false;
+  T::BinopExp* binop = static_cast<T::BinopExp*>(addr);
+  return binop->op == T::PLUS_OP && binop->left->kind == T::Exp::Kind::TEMP &&
+         static_cast<T::TempExp*>(binop->left)->temp == F::FP() &&
+         binop->right->kind == T::Exp::Kind::CONST &&
+         static_cast<T::ConstExp*>(binop->right)->consti == -F::wordSize;
+}
+
+/* FP, a cached link temp or a chain of static links loaded from them.
+ * Nothing stores to these while a call runs, so they can be evaluated
+ * again wherever the callee reads its static link. */
+bool isFramePointer(T::Exp* exp) {
+  if (exp->kind == T::Exp::Kind::TEMP) return true;
+  if (exp->kind != T::Exp::Kind::MEM) return false;
+  T::Exp* addr = static_cast<T::MemExp*>(exp)->exp;
+  if (addr->kind != T::Exp::Kind::BINOP) return false;
+  T::BinopExp* binop = static_cast<T::BinopExp*>(addr);
+  return binop->op == T::PLUS_OP && binop->right->kind == T::Exp::Kind::CONST &&
+         static_cast<T::ConstExp*>(binop->right)->consti == -F::wordSize &&
+         isFramePointer(binop->left);
+}
+
+T::Exp* copyFramePointer(T::Exp* exp) {
+  if (exp->kind == T::Exp::Kind::TEMP)
+    return new T::TempExp(static_cast<T::TempExp*>(exp)->temp);
+  T::BinopExp* addr =
+      static_cast<T::BinopExp*>(static_cast<T::MemExp*>(exp)->exp);
+  return new T::MemExp(new T::BinopExp(T::PLUS_OP, copyFramePointer(addr->left),
+                                       new T::ConstExp(-F::wordSize)));
+}
+
+/* Measures a body and checks that it can be copied into another frame */
+class Checker {
+ public:
+  int size = 0;
+  bool usesStaticLink = false;
+  bool ok = true;
+  std::set<TEMP::Label*> defined;
+  std::set<TEMP::Label*> targets;
+
+  void Exp(T::Exp* exp) {
+    size++;
+    switch (exp->kind) {
+      case T::Exp::Kind::BINOP:
+        Exp(static_cast<T::BinopExp*>(exp)->left);
+        Exp(static_cast<T::BinopExp*>(exp)->right);
+        break;
+      case T::Exp::Kind::MEM:
+        if (isStaticLink(exp))
+          usesStaticLink = true;
+        else
+          Exp(static_cast<T::MemExp*>(exp)->exp);
+        break;
+      case T::Exp::Kind::TEMP:
+        ok = ok && static_cast<T::TempExp*>(exp)->temp != F::FP();
+        break;
+      case T::Exp::Kind::ESEQ:
+        Stm(static_cast<T::EseqExp*>(exp)->stm);
+        Exp(static_cast<T::EseqExp*>(exp)->exp);
+        break;
+      case T::Exp::Kind::CALL: {
+        T::CallExp* call = static_cast<T::CallExp*>(exp);
+        ok = ok && !call->tail;  // would tear down the wrong frame
+        Exp(call->fun);
+        for (T::ExpList* args = call->args; args; args = args->tail)
+          Exp(args->head);
+        break;
+      }
+      default:
+        break;
+    }
+  }
+
+  void Stm(T::Stm* stm) {
+    size++;
+    switch (stm->kind) {
+      case T::Stm::Kind::SEQ:
+        Stm(static_cast<T::SeqStm*>(stm)->left);
+        Stm(static_cast<T::SeqStm*>(stm)->right);
+        break;
+      case T::Stm::Kind::LABEL:
+        defined.insert(static_cast<T::LabelStm*>(stm)->label);
+        break;
+      case T::Stm::Kind::JUMP:
+        for (TEMP::LabelList* l = static_cast<T::JumpStm*>(stm)->jumps; l;
+             l = l->tail)
+          targets.insert(l->head);
+        break;
+      case T::Stm::Kind::CJUMP: {
+        T::CjumpStm* cjump = static_cast<T::CjumpStm*>(stm);
+        targets.insert(cjump->true_label);
+        targets.insert(cjump->false_label);
+        Exp(cjump->left);
+        Exp(cjump->right);
+        break;
+      }
+      case T::Stm::Kind::MOVE:
+        Exp(static_cast<T::MoveStm*>(stm)->dst);
+        Exp(static_cast<T::MoveStm*>(stm)->src);
+        break;
+      case T::Stm::Kind::EXP:
+        Exp(static_cast<T::ExpStm*>(stm)->exp);
+        break;
+    }
+  }
+};
+
+/* Deep copy of a body with temps and local labels renamed */
+class Cloner {
+ public:
+  std::map<TEMP::Temp*, TEMP::Temp*> temps;
+  std::map<TEMP::Label*, TEMP::Label*> labels;
+  TEMP::Temp* staticLink = nullptr;
+  T::Exp* framePointer = nullptr;  // used in place of staticLink when set
+
+  T::Exp* Exp(T::Exp* exp) {
+    switch (exp->kind) {
+      case T::Exp::Kind::BINOP: {
+        T::BinopExp* binop = static_cast<T::BinopExp*>(exp);
+        return new T::BinopExp(binop->op, Exp(binop->left), Exp(binop->right));
+      }
+      case T::Exp::Kind::MEM:
+        if (isStaticLink(exp))
+          return framePointer ? copyFramePointer(framePointer)
+                              : new T::TempExp(staticLink);
+        return new T::MemExp(Exp(static_cast<T::MemExp*>(exp)->exp));
+      case T::Exp::Kind::TEMP:
+        return new T::TempExp(Temp(static_cast<T::TempExp*>(exp)->temp));
+      case T::Exp::Kind::ESEQ: {
+        T::EseqExp* eseq = static_cast<T::EseqExp*>(exp);
+        return new T::EseqExp(Stm(eseq->stm), Exp(eseq->exp));
+      }
+      case T::Exp::Kind::NAME:
+        return new T::NameExp(Label(static_cast<T::NameExp*>(exp)->name));
+      case T::Exp::Kind::CONST:
+        return new T::ConstExp(static_cast<T::ConstExp*>(exp)->consti);
+      case T::Exp::Kind::CALL: {
+        T::CallExp* call = static_cast<T::CallExp*>(exp);
+        return new T::CallExp(Exp(call->fun), ExpList(call->args));
+      }
+    }
+    assert(0);
+    return nullptr;
+  }
+
+  T::Stm* Stm(T::Stm* stm) {
+    switch (stm->kind) {
+      case T::Stm::Kind::SEQ: {
+        T::SeqStm* seq = static_cast<T::SeqStm*>(stm);
+        return new T::SeqStm(Stm(seq->left), Stm(seq->right));
+      }
+      case T::Stm::Kind::LABEL:
+        return new T::LabelStm(Label(static_cast<T::LabelStm*>(stm)->label));
+      case T::Stm::Kind::JUMP: {
+        T::JumpStm* jump = static_cast<T::JumpStm*>(stm);
+        return new T::JumpStm(new T::NameExp(Label(jump->exp->name)),
+                              LabelList(jump->jumps));
+      }
+      case T::Stm::Kind::CJUMP: {
+        T::CjumpStm* cjump = static_cast<T::CjumpStm*>(stm);
+        return new T::CjumpStm(cjump->op, Exp(cjump->left), Exp(cjump->right),
+                               Label(cjump->true_label),
+                               Label(cjump->false_label));
+      }
+      case T::Stm::Kind::MOVE: {
+        T::MoveStm* move = static_cast<T::MoveStm*>(stm);
+        return new T::MoveStm(Exp(move->dst), Exp(move->src));
+      }
+      case T::Stm::Kind::EXP:
+        return new T::ExpStm(Exp(static_cast<T::ExpStm*>(stm)->exp));
+    }
+    assert(0);
+    return nullptr;
+  }
+
+ private:
+  TEMP::Temp* Temp(TEMP::Temp* temp) {
+    if (isRegister(temp)) return temp;
+    auto it = temps.find(temp);
+    if (it != temps.end()) return it->second;
+    return temps[temp] = TEMP::Temp::NewTemp();
+  }
+
+  // Labels defined outside the body (functions, strings) keep their name
+  TEMP::Label* Label(TEMP::Label* label) {
+    auto it = labels.find(label);
+    return it == labels.end() ? label : it->second;
+  }
+
+  T::ExpList* ExpList(T::ExpList* list) {
+    if (!list) return nullptr;
+    T::Exp* head = Exp(list->head);
+    return new T::ExpList(head, ExpList(list->tail));
+  }
+
+  TEMP::LabelList* LabelList(TEMP::LabelList* list) {
+    if (!list) return nullptr;
+    return new TEMP::LabelList(Label(list->head), LabelList(list->tail));
+  }
+};
+
+}  // namespace
+
+namespace TR {
+
+void RecordInlineCandidate(TEMP::Label* label, const std::string& name,
+                           F::Frame* frame, T::Exp* body) {
+  // Anything but the static link in the frame means an escaping variable
+  if (frame->GetSize() != F::wordSize) return;
+
+  Checker checker;
+  checker.Exp(body);
+  if (!checker.ok || checker.size > U::options().inlineBudget) return;
+  for (TEMP::Label* target : checker.targets)
+    if (!checker.defined.count(target)) return;
+
+  Candidate candidate;
+  candidate.name = name;
+  candidate.body = body;
+  candidate.size = checker.size;
+  candidate.usesStaticLink = checker.usesStaticLink;
+  F::AccessList* formals = frame->GetFormalList()->tail;  // skip static link
+  for (; formals; formals = formals->tail) {
+    T::Exp* exp = formals->head->ToExp(nullptr);
+    if (formals->head->kind != F::Access::INREG ||
+        exp->kind != T::Exp::Kind::TEMP)
+      return;
+    candidate.formals.push_back(static_cast<T::TempExp*>(exp)->temp);
+  }
+  candidates[label] = candidate;
+}
+
+T::Exp* ExpandInline(TEMP::Label* label, T::Exp* staticLink, T::ExpList* args,
+                     int pos) {
+  auto it = candidates.find(label);
+  if (it == candidates.end()) return nullptr;
+  const Candidate& candidate = it->second;
+
+  // Same evaluation order as the call: static link first, then arguments
+  Cloner cloner;
+  T::Stm* setup = new T::ExpStm(new T::ConstExp(0));
+  if (candidate.usesStaticLink && isFramePointer(staticLink)) {
+    // Keeps the callee's variables recognizable as frame slots
+    cloner.framePointer = staticLink;
+  } else if (candidate.usesStaticLink) {
+    cloner.staticLink = TEMP::Temp::NewTemp();
+    setup = new T::MoveStm(new T::TempExp(cloner.staticLink), staticLink);
+  }
+  for (TEMP::Temp* formal : candidate.formals) {
+    assert(args);
+    TEMP::Temp* temp = TEMP::Temp::NewTemp();
+    cloner.temps[formal] = temp;
+    setup = new T::SeqStm(setup,
+                          new T::MoveStm(new T::TempExp(temp), args->head));
+    args = args->tail;
+  }
+
+  Checker checker;
+  checker.Exp(candidate.body);
+  for (TEMP::Label* defined : checker.defined)
+    cloner.labels[defined] = TEMP::NewLabel();
+
+  if (U::options().inlineReport)
+    fprintf(stderr, "%s: inlined %s (%d nodes)\n",
+            errormsg.Position(pos).c_str(), candidate.name.c_str(),
+            candidate.size);
+  return new T::EseqExp(setup, cloner.Exp(candidate.body));
+}
+
+}  // namespace TR
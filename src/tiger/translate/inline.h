@@ -0,0 +1,30 @@
+#ifndef TIGER_TRANSLATE_INLINE_H_
+#define TIGER_TRANSLATE_INLINE_H_
+
+#include <string>
+
+#include "tiger/frame/frame.h"
+#include "tiger/translate/tree.h"
+
+namespace TR {
+
+/* Remembers the translated body of a function so later calls may expand it
+ * in place. Only bodies that keep everything in temps qualify: no escaping
+ * formals or locals, no nested functions taking FP as their static link,
+ * and no more than U::options().inlineBudget IR nodes. */
+void RecordInlineCandidate(TEMP::Label* label, const std::string& name,
+                           F::Frame* frame, T::Exp* body);
+
+/* Expands a call to the function at label with the given static link and
+ * arguments, or returns nullptr when the function is not a candidate. The
+ * copy gets fresh temps and labels; formals become temps initialized from
+ * args and every MEM(FP - wordSize) becomes the caller's static link, so
+ * free variables still resolve through the callee's static chain. A static
+ * link that is FP, a cached link temp or a chain of loads from them is
+ * substituted as is, so the callee's variables stay frame slots. */
+T::Exp* ExpandInline(TEMP::Label* label, T::Exp* staticLink, T::ExpList* args,
+                     int pos);
+
+}  // namespace TR
+
+#endif  // TIGER_TRANSLATE_INLINE_H_
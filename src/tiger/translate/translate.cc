@@ -1,6 +1,7 @@
 #include "tiger/translate/translate.h"
 
 #include <cstdio>
+#include <map>
 #include <set>
 #include <string>
 #include <iostream>
@@ -10,6 +11,8 @@
 #include "tiger/frame/temp.h"
 #include "tiger/semant/semant.h"
 #include "tiger/semant/types.h"
+#include "tiger/translate/inline.h"
+#include "tiger/util/options.h"
 #include "tiger/util/util.h"
 
 extern EM::ErrorMsg errormsg;
@@ -26,6 +29,32 @@ namespace {
   const std::string stringEqual = "stringEqual";
   const std::string allocRecord = "allocRecord";
   const std::string initArray = "initArray";
+  const std::string boundsError = "boundsError";
+  const std::string heapPtrName = "tiger_heap_ptr";
+  const std::string heapLimitName = "tiger_heap_limit";
+  std::set<const A::CallExp *> tailCalls;
+
+  /* Where the fields of a record live, one word each. Pointer fields come
+   * first so the collector only scans a prefix of the record. */
+  struct RecordLayout {
+    std::vector<int> offsets;  // in declaration order
+    TEMP::Label* descriptor;
+  };
+  std::map<TY::RecordTy *, RecordLayout> recordLayouts;
+  long recordTypeIds = 0;
+  std::map<std::string, TEMP::Label *> stringLiterals;
+  std::vector<std::string> allocSites;  // with --alloc-profile, by site id
+
+  /* Bounds check elimination. A Bound is var + offset, or just offset
+   * when var is null. Only variables that never change after their
+   * declaration (stableVars) can appear in one. */
+  struct Bound {
+    E::VarEntry* var;
+    int offset;
+  };
+  std::set<E::VarEntry *> stableVars;
+  std::map<E::VarEntry *, Bound> arrayLengths;
+  std::map<E::VarEntry *, std::pair<int, Bound> > loopRanges;
 
   void AddToGlobalFrags(F::Frag* newFrag) {
     F::FragList* tail = globalFrags;
@@ -43,16 +72,27 @@ namespace {
   T::ExpList* ToExpList(const std::vector<TR::Exp *> &formalsVector);
   TR::Exp* Calculate(A::Oper op, TR::Exp* left, TR::Exp* right);
   TR::Exp* Conditional(A::Oper op, TR::Exp* left, TR::Exp* right, bool isString);
-  TR::Exp* Record(const std::vector<TR::Exp *> &recordVector);
+  T::Exp* Offset(TEMP::Temp* base, int offset);
+  bool StaticBound(A::Exp* exp, S::Table<E::EnvEntry>* venv, Bound* bound);
+  bool InBounds(A::Var* var, A::Exp* subscript, S::Table<E::EnvEntry>* venv);
+  TR::Exp* Subscript(TR::Exp* array, TR::Exp* index, bool checked);
+  T::ExpList* AllocSite(T::ExpList* args, int pos, const std::string &kind);
+  TR::Exp* Record(const std::vector<TR::Exp *> &recordVector, TY::RecordTy* recordTy, int pos);
   TR::Exp* Seq(TR::Exp* before, TR::Exp* newExp);
   TR::Exp* Assign(TR::Exp* left, TR::Exp* right);
   TR::Exp* If(TR::Exp* test, TR::Exp* then, TR::Exp* elsee);
   TR::Exp* While(TR::Exp* test, TR::Exp* body, TEMP::Label* done);
   TR::Exp* For(TR::Access* loopVarAccess, TR::Exp* lo, TR::Exp* hi, TR::Exp* body, TR::Level* level, TEMP::Label* done);
   TR::Exp* Let(const std::vector<TR::Exp *> &decsVector, TR::Exp* body);
-  TR::Exp* Array(TR::Exp* init, TR::Exp* size);
+  TR::Exp* Array(TR::Exp* init, TR::Exp* size, TY::Ty* elementTy, int pos);
   TR::Exp* EmptyExp();
+  bool IsPointer(TY::Ty* ty);
+  const RecordLayout& Layout(TY::RecordTy* recordTy);
   TR::Exp* VarDecInit(TR::Access* access, TR::Exp* exp);
+  void MarkTailCalls(A::Exp* exp);
+  int StackArgNumber(F::Frame* frame);
+  TR::Exp* SelfTailCall(TR::Level* level, T::ExpList* args);
+  TR::Exp* TailCall(TEMP::Label* label, T::ExpList* args);
 
   void procEntryExit(TR::Level* level, TR::Exp* body, TR::AccessList* formals);
 
@@ -114,12 +154,23 @@ class Level {
 
   static AccessList *Formals(Level *level);
 
+  /* The frame pointer of ancestor, which is this level or encloses it.
+   * Normally a chain of static-link loads, one per level crossed; with
+   * U::options().cachedLinks a temp loaded once on entry. */
+  T::Exp *FramePtr(Level *ancestor);
+
+  /* body preceded by the loads of the cached links FramePtr handed out */
+  T::Exp *LoadLinks(T::Exp *body);
+
   static Level *NewLevel(Level *parent, TEMP::Label *name, U::BoolList *formals) {
     U::BoolList* formalsWithStaticLink = new U::BoolList(true, formals);
     F::Frame* frame = F::NewX64Frame(name, formalsWithStaticLink);
     Level* level = new Level(frame, parent);
     return level;
   }
+
+ private:
+  std::vector<TEMP::Temp *> links;  // links[k] holds the frame pointer k + 1 levels up
 };
 
 class Access {
@@ -280,6 +331,10 @@ F::FragList *TranslateProgram(A::Exp *root) {
   return globalFrags;
 }
 
+const std::vector<std::string> &AllocSites() {
+  return allocSites;
+}
+
  AccessList* Level::Formals(Level *level) {
     F::AccessList* f_accessList = level->frame->GetFormalList();
     AccessList* result = nullptr;
@@ -300,6 +355,35 @@ F::FragList *TranslateProgram(A::Exp *root) {
     return nullptr;
  }
 
+T::Exp *Level::FramePtr(Level *ancestor) {
+  std::size_t depth = 0;
+  for (Level *l = this; l != ancestor; l = l->parent) {
+    assert(l);
+    depth++;
+  }
+  if (depth == 0)
+    return new T::TempExp(F::FP());
+  if (U::options().cachedLinks) {
+    while (links.size() < depth)
+      links.push_back(TEMP::Temp::NewTemp());
+    return new T::TempExp(links[depth - 1]);
+  }
+  T::Exp *framePtr = new T::TempExp(F::FP());
+  for (; depth > 0; --depth) // static link is the first in-frame parameter
+    framePtr = new T::MemExp(new T::BinopExp(T::PLUS_OP, framePtr, new T::ConstExp(-F::wordSize)));
+  return framePtr;
+}
+
+T::Exp *Level::LoadLinks(T::Exp *body) {
+  // Each link is loaded through the one before, so the chain is walked once
+  for (std::size_t k = links.size(); k-- > 0;) {
+    T::Exp *framePtr = new T::TempExp(k == 0 ? F::FP() : links[k - 1]);
+    T::Exp *load = new T::MemExp(new T::BinopExp(T::PLUS_OP, framePtr, new T::ConstExp(-F::wordSize)));
+    body = new T::EseqExp(new T::MoveStm(new T::TempExp(links[k]), load), body);
+  }
+  return body;
+}
+
 }  // namespace TR
 
 namespace A {
@@ -321,11 +405,7 @@ TR::ExpAndTy SimpleVar::Translate(S::Table<E::EnvEntry> *venv,
 
   TY::Ty* resultType = static_cast<E::VarEntry*>(envEntry)->ty;
   TR::Level* resultLevel = static_cast<E::VarEntry*>(envEntry)->access->level;
-  T::Exp* framePtr = new T::TempExp(F::FP());
-  while (level != resultLevel) {
-    framePtr = new T::MemExp(new T::BinopExp(T::PLUS_OP, framePtr, new T::ConstExp(-F::wordSize))); // static link is the first in-frame parameter
-    level = level->parent;
-  }
+  T::Exp* framePtr = level->FramePtr(resultLevel);
   T::Exp* resultPtr = static_cast<E::VarEntry*>(envEntry)->access->access->ToExp(framePtr);
   return TR::ExpAndTy(new TR::ExExp(resultPtr), resultType);
 }
@@ -360,7 +440,8 @@ TR::ExpAndTy FieldVar::Translate(S::Table<E::EnvEntry> *venv,
   /* ----------------------------------------------------------------------- */
 
   TR::Exp* exp = varResult.exp;
-  TR::Exp* fieldExp = new TR::ExExp(new T::MemExp(new T::BinopExp(T::PLUS_OP, exp->UnEx(), new T::ConstExp(order * F::wordSize))));
+  int offset = Layout(recordTy).offsets[order];
+  TR::Exp* fieldExp = new TR::ExExp(new T::MemExp(new T::BinopExp(T::PLUS_OP, exp->UnEx(), new T::ConstExp(offset))));
   return TR::ExpAndTy(fieldExp, fieldType);
 }
 
@@ -387,10 +468,8 @@ TR::ExpAndTy SubscriptVar::Translate(S::Table<E::EnvEntry> *venv,
 
   /* ----------------------------------------------------------------------- */
 
-  TR::Exp* resultExp = new TR::ExExp(
-                        new T::MemExp(
-                          new T::BinopExp(T::PLUS_OP, varExp->UnEx(), 
-                            new T::BinopExp(T::MUL_OP, subscriptExp->UnEx(), new T::ConstExp(F::wordSize)))));
+  bool checked = U::options().boundsCheck && !InBounds(var, subscript, venv);
+  TR::Exp* resultExp = Subscript(varExp, subscriptExp, checked);
   return TR::ExpAndTy(resultExp, elementType);
 }
 
@@ -418,10 +497,12 @@ TR::ExpAndTy IntExp::Translate(S::Table<E::EnvEntry> *venv,
 TR::ExpAndTy StringExp::Translate(S::Table<E::EnvEntry> *venv,
                                   S::Table<TY::Ty> *tenv, TR::Level *level,
                                   TEMP::Label *label) const {
-  // TODO: P166-167
-  TEMP::Label* tempLabel = TEMP::NewLabel();
-  F::Frag* stringFrag = new F::StringFrag(tempLabel, s);
-  AddToGlobalFrags(stringFrag);
+  // P166-167, one fragment per distinct literal so equal literals share a pointer
+  TEMP::Label*& tempLabel = stringLiterals[s];
+  if (!tempLabel) {
+    tempLabel = TEMP::NewLabel();
+    AddToGlobalFrags(new F::StringFrag(tempLabel, s));
+  }
   return TR::ExpAndTy(new TR::ExExp(new T::NameExp(tempLabel)), TY::StringTy::Instance());
 }
 
@@ -473,20 +554,32 @@ TR::ExpAndTy CallExp::Translate(S::Table<E::EnvEntry> *venv,
 
   /* ----------------------------------------------------------------------- */
 
-  T::Exp* staticLink = new T::TempExp(F::FP());
-  while (level != funEntry->level->parent) {
-    staticLink = new T::MemExp(new T::BinopExp(T::PLUS_OP, staticLink, new T::ConstExp(-F::wordSize)));
-    level = level->parent;
-  }
+  TR::Level* caller = level;
+  bool tail = tailCalls.find(this) != tailCalls.end();
   T::ExpList* expList = ToExpList(formalsVector);
   TR::Exp* resultExp = nullptr;
   if (funEntry->level->parent == nullptr) {
     // External call, no static link
+    if (func->Name() == "concat")
+      expList = AllocSite(expList, pos, "string");
     resultExp = new TR::ExExp(F::externalCall(func->Name(), expList)); // External functions will have a null label, see env.cc
   }
+  else if (tail && funEntry->level == caller) {
+    // Self tail recursion, the static link stays the same
+    resultExp = SelfTailCall(caller, expList);
+  }
+  else if (T::Exp* inlined = TR::ExpandInline(funEntry->label, caller->FramePtr(funEntry->level->parent), expList, pos)) {
+    resultExp = new TR::ExExp(inlined);
+  }
+  else if (tail && funEntry->level->parent != caller &&
+           StackArgNumber(funEntry->level->frame) <= StackArgNumber(caller->frame)) {
+    // The callee must not be nested in the caller, whose frame goes away
+    expList = new T::ExpList(caller->FramePtr(funEntry->level->parent), expList);
+    resultExp = TailCall(funEntry->label, expList);
+  }
   else {
     // Add static link
-    expList = new T::ExpList(staticLink, expList);
+    expList = new T::ExpList(caller->FramePtr(funEntry->level->parent), expList);
     resultExp = new TR::ExExp(new T::CallExp(new T::NameExp(funEntry->label), expList));
   }
   return TR::ExpAndTy(resultExp, resultType);
@@ -580,7 +673,7 @@ TR::ExpAndTy RecordExp::Translate(S::Table<E::EnvEntry> *venv,
 
   /* ----------------------------------------------------------------------- */
 
-  TR::Exp* exp = Record(recordFieldsVector);
+  TR::Exp* exp = Record(recordFieldsVector, realRecordType, pos);
   return TR::ExpAndTy(exp, recordType);
 } 
 
@@ -707,8 +800,13 @@ TR::ExpAndTy ForExp::Translate(S::Table<E::EnvEntry> *venv,
     valid = false;
   }
   TR::Access* loopVarAccess = TR::Access::AllocLocal(level, escape);
+  E::VarEntry* loopVar = new E::VarEntry(loopVarAccess, TY::IntTy::Instance(), true);
+  Bound loBound, hiBound;
+  stableVars.insert(loopVar);  // within one iteration
+  if (StaticBound(lo, venv, &loBound) && !loBound.var && StaticBound(hi, venv, &hiBound))
+    loopRanges[loopVar] = std::make_pair(loBound.offset, hiBound);
   venv->BeginScope();
-  venv->Enter(var, new E::VarEntry(loopVarAccess, TY::IntTy::Instance(), true));
+  venv->Enter(var, loopVar);
   TR::ExpAndTy bodyResult = body->Translate(venv, tenv, level, done); // Pass label "done" as a parameter
   TR::Exp* result = For(loopVarAccess, loResult.exp, hiResult.exp, bodyResult.exp, level, done);
   if (!bodyResult.ty || !bodyResult.ty->IsSameType(TY::VoidTy::Instance())) {
@@ -774,7 +872,7 @@ TR::ExpAndTy ArrayExp::Translate(S::Table<E::EnvEntry> *venv,
     errormsg.Error(pos, "type mismatch");
     return TR::ExpAndTy(EmptyExp(), TY::VoidTy::Instance());
   }
-  TR::Exp* initExp = Array(initResult.exp, sizeResult.exp);
+  TR::Exp* initExp = Array(initResult.exp, sizeResult.exp, actualTy->ty, pos);
   return TR::ExpAndTy(initExp, actualTy);
 }
 
@@ -830,10 +928,14 @@ TR::Exp *FunctionDec::Translate(S::Table<E::EnvEntry> *venv,
     TR::AccessList* thisAccessListHead = thisAccessList;
     TY::TyList* thisTyList = thisFunEntry->formals;
     venv->BeginScope();
+    MarkTailCalls(thisFun->body);
     for (; thisFieldList; thisFieldList = thisFieldList->tail, thisAccessList = thisAccessList->tail, thisTyList = thisTyList->tail) {
       assert(thisAccessList);
       assert(thisTyList);
-      venv->Enter(thisFieldList->head->name, new E::VarEntry(thisAccessList->head, thisTyList->head));
+      E::VarEntry* param = new E::VarEntry(thisAccessList->head, thisTyList->head);
+      if (!thisFieldList->head->assigned)
+        stableVars.insert(param);
+      venv->Enter(thisFieldList->head->name, param);
     }
 
     // Translate function body
@@ -846,7 +948,9 @@ TR::Exp *FunctionDec::Translate(S::Table<E::EnvEntry> *venv,
         errormsg.Error(pos, "return value mismatch");
       }
     }
-    procEntryExit(thisFunEntry->level, thisFunResult.exp, thisAccessListHead);
+    T::Exp* bodyExp = thisFunEntry->level->LoadLinks(thisFunResult.exp->UnEx());
+    TR::RecordInlineCandidate(thisFunEntry->label, thisFun->name->Name(), thisFunEntry->level->frame, bodyExp);
+    procEntryExit(thisFunEntry->level, new TR::ExExp(bodyExp), thisAccessListHead);
     venv->EndScope();
     funHead = funHead->tail;
   }
@@ -857,6 +961,9 @@ TR::Exp *VarDec::Translate(S::Table<E::EnvEntry> *venv, S::Table<TY::Ty> *tenv,
                            TR::Level *level, TEMP::Label *label) const {
   TR::ExpAndTy initResult = init->Translate(venv, tenv, level, label);
   TR::Access* access = TR::Access::AllocLocal(level, escape);
+  Bound length;
+  bool knownLength = !assigned && init->kind == A::Exp::ARRAY &&
+                     StaticBound(static_cast<A::ArrayExp *>(init)->size, venv, &length);
   if (typ) {
     TY::Ty* type = tenv->Look(typ);
     if (!type) {
@@ -879,6 +986,11 @@ TR::Exp *VarDec::Translate(S::Table<E::EnvEntry> *venv, S::Table<TY::Ty> *tenv,
       venv->Enter(var, new E::VarEntry(access, initResult.ty));
     }
   }
+  E::VarEntry* entry = static_cast<E::VarEntry *>(venv->Look(var));
+  if (!assigned)
+    stableVars.insert(entry);
+  if (knownLength)
+    arrayLengths[entry] = length;
   return VarDecInit(access, initResult.exp);
 }
 
@@ -1030,21 +1142,201 @@ namespace {
     return new TR::CxExp(trues, falses, stm);
   }
 
-  TR::Exp* Record(const std::vector<TR::Exp *> &recordVector) {
-    // TODO: Eliminate NewTemp here
+  // Values the collector has to follow
+  bool IsPointer(TY::Ty* ty) {
+    TY::Ty::Kind kind = ty->ActualTy()->kind;
+    return kind == TY::Ty::RECORD || kind == TY::Ty::ARRAY || kind == TY::Ty::STRING;
+  }
+
+  // The descriptor is the field count, a type id and the range of
+  // pointer fields, see struct record_desc in runtime.c
+  const RecordLayout& Layout(TY::RecordTy* recordTy) {
+    auto it = recordLayouts.find(recordTy);
+    if (it != recordLayouts.end())
+      return it->second;
+    RecordLayout& layout = recordLayouts[recordTy];
+    long fields = 0, pointers = 0;
+    for (TY::FieldList* f = recordTy->fields; f; f = f->tail, ++fields)
+      if (IsPointer(f->head->ty))
+        ++pointers;
+    int nextPointer = 0, nextValue = pointers;
+    for (TY::FieldList* f = recordTy->fields; f; f = f->tail)
+      layout.offsets.push_back((IsPointer(f->head->ty) ? nextPointer++ : nextValue++) * F::wordSize);
+    layout.descriptor = TEMP::NewLabel();
+    std::vector<long> words = {fields, ++recordTypeIds, 0, pointers};
+    AddToGlobalFrags(new F::DataFrag(layout.descriptor, words));
+    return layout;
+  }
+
+  // Matches `c`, `v`, `v + c` and `v - c` for a stable variable v
+  bool StaticBound(A::Exp* exp, S::Table<E::EnvEntry>* venv, Bound* bound) {
+    bound->var = nullptr;
+    bound->offset = 0;
+    if (exp->kind == A::Exp::OP) {
+      A::OpExp* opExp = static_cast<A::OpExp *>(exp);
+      if ((opExp->oper != A::PLUS_OP && opExp->oper != A::MINUS_OP) || opExp->right->kind != A::Exp::INT)
+        return false;
+      bound->offset = static_cast<A::IntExp *>(opExp->right)->i * (opExp->oper == A::PLUS_OP ? 1 : -1);
+      exp = opExp->left;
+    }
+    if (exp->kind == A::Exp::INT) {
+      bound->offset += static_cast<A::IntExp *>(exp)->i;
+      return true;
+    }
+    if (exp->kind != A::Exp::VAR || static_cast<A::VarExp *>(exp)->var->kind != A::Var::SIMPLE)
+      return false;
+    E::EnvEntry* entry = venv->Look(static_cast<A::SimpleVar *>(static_cast<A::VarExp *>(exp)->var)->sym);
+    if (!entry || entry->kind != E::EnvEntry::VAR || !stableVars.count(static_cast<E::VarEntry *>(entry)))
+      return false;
+    bound->var = static_cast<E::VarEntry *>(entry);
+    return true;
+  }
+
+  // True when var[subscript] is known to be in range: var is an array of
+  // known length and subscript a constant, or a loop variable plus a
+  // constant whose range fits that length
+  bool InBounds(A::Var* var, A::Exp* subscript, S::Table<E::EnvEntry>* venv) {
+    if (var->kind != A::Var::SIMPLE)
+      return false;
+    E::EnvEntry* entry = venv->Look(static_cast<A::SimpleVar *>(var)->sym);
+    if (!entry || entry->kind != E::EnvEntry::VAR)
+      return false;
+    auto length = arrayLengths.find(static_cast<E::VarEntry *>(entry));
+    Bound index;
+    if (length == arrayLengths.end() || !StaticBound(subscript, venv, &index))
+      return false;
+    int lo = index.offset;
+    Bound hi = {nullptr, index.offset};
+    if (index.var) {
+      auto range = loopRanges.find(index.var);
+      if (range == loopRanges.end())
+        return false;
+      lo += range->second.first;
+      hi.var = range->second.second.var;
+      hi.offset += range->second.second.offset;
+    }
+    return lo >= 0 && hi.var == length->second.var && hi.offset < length->second.offset;
+  }
+
+  bool IsPure(T::Exp* exp) {
+    switch (exp->kind) {
+      case T::Exp::TEMP:
+      case T::Exp::CONST:
+      case T::Exp::NAME:
+        return true;
+      case T::Exp::MEM:
+        return IsPure(static_cast<T::MemExp *>(exp)->exp);
+      case T::Exp::BINOP:
+        return IsPure(static_cast<T::BinopExp *>(exp)->left) && IsPure(static_cast<T::BinopExp *>(exp)->right);
+      default:
+        return false;
+    }
+  }
+
+  // The length of an array is the size word of its header, see runtime.c.
+  // A negative index compares as a huge unsigned one.
+  TR::Exp* Subscript(TR::Exp* array, TR::Exp* index, bool checked) {
+    T::Exp* arrayExp = array->UnEx();
+    T::Exp* indexExp = index->UnEx();
+    T::Stm* check = nullptr;
+    if (checked) {
+      check = new T::ExpStm(new T::ConstExp(0));
+      // An impure index may store to the variable holding the array, which
+      // must still be read before the index as without the check
+      bool indexPure = IsPure(indexExp);
+      if (!IsPure(arrayExp) || (!indexPure && arrayExp->kind != T::Exp::TEMP)) {
+        TEMP::Temp* temp = TEMP::Temp::NewTemp();
+        check = new T::MoveStm(new T::TempExp(temp), arrayExp);
+        arrayExp = new T::TempExp(temp);
+      }
+      if (!indexPure) {
+        TEMP::Temp* temp = TEMP::Temp::NewTemp();
+        check = new T::SeqStm(check, new T::MoveStm(new T::TempExp(temp), indexExp));
+        indexExp = new T::TempExp(temp);
+      }
+      T::Exp* length = new T::MemExp(new T::BinopExp(T::PLUS_OP, arrayExp, new T::ConstExp(-F::wordSize)));
+      TEMP::Label* ok = TEMP::NewLabel();
+      TEMP::Label* error = TEMP::NewLabel();
+      check = new T::SeqStm(check,
+        new T::SeqStm(new T::CjumpStm(T::ULT_OP, indexExp, length, ok, error),
+        new T::SeqStm(new T::LabelStm(error),
+        new T::SeqStm(new T::ExpStm(F::externalCall(boundsError, new T::ExpList(indexExp, new T::ExpList(length, nullptr)))),
+          new T::LabelStm(ok)))));
+    }
+    T::Exp* element = new T::MemExp(
+      new T::BinopExp(T::PLUS_OP, arrayExp,
+        new T::BinopExp(T::MUL_OP, indexExp, new T::ConstExp(F::wordSize))));
+    return new TR::ExExp(check ? new T::EseqExp(check, element) : element);
+  }
+
+  T::Exp* Offset(TEMP::Temp* base, int offset) {
+    return new T::BinopExp(T::PLUS_OP, new T::TempExp(base), new T::ConstExp(offset));
+  }
+
+  // With --alloc-profile, numbers the allocation at pos and passes the
+  // number as one more argument, see the allocation profile in runtime.c
+  T::ExpList* AllocSite(T::ExpList* args, int pos, const std::string &kind) {
+    if (!U::options().allocProfile)
+      return args;
+    T::ExpList* site = new T::ExpList(new T::ConstExp(allocSites.size()), nullptr);
+    allocSites.push_back(errormsg.Position(pos) + " " + kind);
+    if (!args)
+      return site;
+    T::ExpList* tail = args;
+    while (tail->tail)
+      tail = tail->tail;
+    tail->tail = site;
+    return args;
+  }
+
+  // Bumps tiger_heap_ptr inline and writes the header itself; allocRecord
+  // is only called when the current block of the heap is full, or always
+  // with --alloc-profile so that every record is counted.
+  // The fields are evaluated first, so no collection can see the record
+  // before every field is stored.
+  TR::Exp* Record(const std::vector<TR::Exp *> &recordVector, TY::RecordTy* recordTy, int pos) {
     // P168
     std::size_t s = recordVector.size();
     if (s == 0)
       return EmptyExp();
-    TEMP::Temp* r = TEMP::Temp::NewTemp();
-    T::Exp* initRecord = F::externalCall(allocRecord, new T::ExpList(new T::ConstExp(s * F::wordSize), nullptr));
-    T::Stm* stm = new T::MoveStm(new T::TempExp(r), initRecord);
+    T::Stm* stm = new T::ExpStm(new T::ConstExp(0));
+    std::vector<TEMP::Temp *> fields;
     for (std::size_t i = 0; i < s; ++i) {
-      T::Exp* exp = recordVector[i]->UnEx();
-      stm = new T::SeqStm(stm, 
-        new T::MoveStm(new T::MemExp(new T::BinopExp(T::PLUS_OP, new T::TempExp(r), new T::ConstExp(i * F::wordSize))),
-          exp));
+      fields.push_back(TEMP::Temp::NewTemp());
+      stm = new T::SeqStm(stm, new T::MoveStm(new T::TempExp(fields[i]), recordVector[i]->UnEx()));
     }
+
+    TEMP::Label* heapPtr = TEMP::NamedLabel(heapPtrName);
+    TEMP::Label* heapLimit = TEMP::NamedLabel(heapLimitName);
+    TEMP::Temp* r = TEMP::Temp::NewTemp();
+    TEMP::Temp* next = TEMP::Temp::NewTemp();
+    const RecordLayout& layout = Layout(recordTy);
+    TEMP::Label* descriptor = layout.descriptor;
+    TEMP::Label* fast = TEMP::NewLabel();
+    TEMP::Label* slow = TEMP::NewLabel();
+    TEMP::Label* done = TEMP::NewLabel();
+    T::Stm* header = new T::SeqStm(
+      new T::MoveStm(new T::MemExp(new T::NameExp(heapPtr)), new T::TempExp(next)),
+      new T::SeqStm(new T::MoveStm(new T::MemExp(new T::TempExp(r)), new T::NameExp(descriptor)),
+      new T::SeqStm(new T::MoveStm(new T::MemExp(Offset(r, F::wordSize)), new T::ConstExp(s)),
+        new T::MoveStm(new T::TempExp(r), Offset(r, 2 * F::wordSize)))));
+    T::Exp* initRecord = F::externalCall(allocRecord, AllocSite(new T::ExpList(new T::NameExp(descriptor), nullptr), pos, "record"));
+    if (U::options().allocProfile)
+      stm = new T::SeqStm(stm, new T::MoveStm(new T::TempExp(r), initRecord));
+    else
+      stm = new T::SeqStm(stm,
+      new T::SeqStm(new T::MoveStm(new T::TempExp(r), new T::MemExp(new T::NameExp(heapPtr))),
+      new T::SeqStm(new T::MoveStm(new T::TempExp(next), Offset(r, (s + 2) * F::wordSize)),
+      new T::SeqStm(new T::CjumpStm(T::GT_OP, new T::TempExp(next), new T::MemExp(new T::NameExp(heapLimit)), slow, fast),
+      new T::SeqStm(new T::LabelStm(fast),
+      new T::SeqStm(header,
+      new T::SeqStm(new T::JumpStm(new T::NameExp(done), new TEMP::LabelList(done, nullptr)),
+      new T::SeqStm(new T::LabelStm(slow),
+      new T::SeqStm(new T::MoveStm(new T::TempExp(r), initRecord),
+        new T::LabelStm(done))))))))));
+
+    for (std::size_t i = 0; i < s; ++i)
+      stm = new T::SeqStm(stm, new T::MoveStm(new T::MemExp(Offset(r, layout.offsets[i])), new T::TempExp(fields[i])));
     return new TR::ExExp(new T::EseqExp(stm, new T::TempExp(r)));
   }
 
@@ -1160,8 +1452,10 @@ namespace {
     return new TR::ExExp(new T::EseqExp(stm, body->UnEx()));
   }
 
-  TR::Exp* Array(TR::Exp* init, TR::Exp* size) {
-    T::Exp* initCall = F::externalCall(initArray, new T::ExpList(size->UnEx(), new T::ExpList(init->UnEx(), nullptr)));
+  TR::Exp* Array(TR::Exp* init, TR::Exp* size, TY::Ty* elementTy, int pos) {
+    T::Exp* pointers = new T::ConstExp(IsPointer(elementTy) ? 1 : 0);
+    T::ExpList* args = new T::ExpList(size->UnEx(), new T::ExpList(init->UnEx(), new T::ExpList(pointers, nullptr)));
+    T::Exp* initCall = F::externalCall(initArray, AllocSite(args, pos, "array"));
     return new TR::ExExp(initCall);
   }
 
@@ -1169,6 +1463,79 @@ namespace {
     return new TR::NxExp(new T::MoveStm(access->access->ToExp(new T::TempExp(F::FP())), exp->UnEx()));
   }
 
+  // Calls whose value is the value of the whole function body
+  void MarkTailCalls(A::Exp* exp) {
+    switch (exp->kind) {
+      case A::Exp::CALL:
+        tailCalls.insert(static_cast<A::CallExp *>(exp));
+        break;
+      case A::Exp::SEQ: {
+        A::ExpList* seq = static_cast<A::SeqExp *>(exp)->seq;
+        while (seq && seq->tail)
+          seq = seq->tail;
+        if (seq)
+          MarkTailCalls(seq->head);
+        break;
+      }
+      case A::Exp::LET:
+        MarkTailCalls(static_cast<A::LetExp *>(exp)->body);
+        break;
+      case A::Exp::IF: {
+        A::IfExp* ifExp = static_cast<A::IfExp *>(exp);
+        MarkTailCalls(ifExp->then);
+        if (ifExp->elsee)
+          MarkTailCalls(ifExp->elsee);
+        break;
+      }
+      default:
+        break;
+    }
+  }
+
+  // Number of incoming arguments passed on the stack, static link included
+  int StackArgNumber(F::Frame* frame) {
+    int count = 0;
+    for (F::AccessList* formals = frame->GetFormalList(); formals; formals = formals->tail)
+      count++;
+    return count > 6 ? count - 6 : 0;
+  }
+
+  TR::Exp* SelfTailCall(TR::Level* level, T::ExpList* args) {
+    // Evaluate every argument before any formal is overwritten
+    std::vector<TEMP::Temp *> temps;
+    T::Stm* stm = new T::ExpStm(new T::ConstExp(0));
+    for (; args; args = args->tail) {
+      temps.push_back(TEMP::Temp::NewTemp());
+      stm = new T::SeqStm(stm, new T::MoveStm(new T::TempExp(temps.back()), args->head));
+    }
+    std::size_t i = 0;
+    for (TR::AccessList* formals = TR::Level::Formals(level); formals; formals = formals->tail, ++i) {
+      T::Exp* formal = formals->head->access->ToExp(new T::TempExp(F::FP()));
+      stm = new T::SeqStm(stm, new T::MoveStm(formal, new T::TempExp(temps[i])));
+    }
+    TEMP::Label* entry = level->frame->GetEntryLabel();
+    stm = new T::SeqStm(stm, new T::JumpStm(new T::NameExp(entry), new TEMP::LabelList(entry, nullptr)));
+    return new TR::ExExp(new T::EseqExp(stm, new T::ConstExp(0)));
+  }
+
+  TR::Exp* TailCall(TEMP::Label* label, T::ExpList* args) {
+    // Stack arguments overwrite the incoming ones, so evaluate everything first
+    T::ExpList* temps = nullptr;
+    T::ExpList* tail = nullptr;
+    T::Stm* stm = new T::ExpStm(new T::ConstExp(0));
+    for (; args; args = args->tail) {
+      TEMP::Temp* temp = TEMP::Temp::NewTemp();
+      stm = new T::SeqStm(stm, new T::MoveStm(new T::TempExp(temp), args->head));
+      T::ExpList* cell = new T::ExpList(new T::TempExp(temp), nullptr);
+      if (tail)
+        tail->tail = cell;
+      else
+        temps = cell;
+      tail = cell;
+    }
+    return new TR::ExExp(new T::EseqExp(stm, new T::CallExp(new T::NameExp(label), temps, true)));
+  }
+
   void procEntryExit(TR::Level* level, TR::Exp* body, TR::AccessList* formals) {
     // P171-173
     // TODO: Consider procedure call without return value
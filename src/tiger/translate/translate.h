@@ -1,6 +1,9 @@
 #ifndef TIGER_TRANSLATE_TRANSLATE_H_
 #define TIGER_TRANSLATE_TRANSLATE_H_
 
+#include <string>
+#include <vector>
+
 #include "tiger/absyn/absyn.h"
 #include "tiger/frame/frame.h"
 
@@ -19,6 +22,9 @@ Level* Outermost();
 
 F::FragList* TranslateProgram(A::Exp*);
 
+// "file:line.col kind" of every allocation numbered for --alloc-profile
+const std::vector<std::string>& AllocSites();
+
 }  // namespace TR
 
 #endif
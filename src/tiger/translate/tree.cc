@@ -112,7 +112,7 @@ void ConstExp::Print(FILE *out, int d) const {
 void CallExp::Print(FILE *out, int d) const {
   ExpList *args = this->args;
   indent(out, d);
-  fprintf(out, "CALL(\n");
+  fprintf(out, this->tail ? "TAILCALL(\n" : "CALL(\n");
   this->fun->Print(out, d + 1);
   for (; args; args = args->tail) {
     fprintf(out, ",\n");
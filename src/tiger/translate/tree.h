@@ -61,9 +61,6 @@ class Stm {
 
   Stm(Kind kind) : kind(kind) {}
   virtual void Print(FILE* out, int d) const = 0;
-
-  /*Lab6 only*/
-  virtual Stm* Canon(Stm*) = 0;
 };
 
 class SeqStm : public Stm {
@@ -74,9 +71,6 @@ class SeqStm : public Stm {
     assert(left);
   }
   void Print(FILE* out, int d) const override;
-
-  /*Lab6 only*/
-  Stm* Canon(Stm*) override;
 };
 
 class LabelStm : public Stm {
@@ -85,9 +79,6 @@ class LabelStm : public Stm {
 
   LabelStm(TEMP::Label* label) : Stm(LABEL), label(label) {}
   void Print(FILE* out, int d) const override;
-
-  /*Lab6 only*/
-  Stm* Canon(Stm*) override;
 };
 
 class JumpStm : public Stm {
@@ -98,9 +89,6 @@ class JumpStm : public Stm {
   JumpStm(NameExp* exp, TEMP::LabelList* jumps)
       : Stm(JUMP), exp(exp), jumps(jumps) {}
   void Print(FILE* out, int d) const override;
-
-  /*Lab6 only*/
-  Stm* Canon(Stm*) override;
 };
 
 class CjumpStm : public Stm {
@@ -118,9 +106,6 @@ class CjumpStm : public Stm {
         true_label(true_label),
         false_label(false_label) {}
   void Print(FILE* out, int d) const override;
-
-  /*Lab6 only*/
-  Stm* Canon(Stm*) override;
 };
 
 class MoveStm : public Stm {
@@ -129,9 +114,6 @@ class MoveStm : public Stm {
 
   MoveStm(Exp* dst, Exp* src) : Stm(MOVE), dst(dst), src(src) {}
   void Print(FILE* out, int d) const override;
-
-  /*Lab6 only*/
-  Stm* Canon(Stm*) override;
 };
 
 class ExpStm : public Stm {
@@ -140,9 +122,6 @@ class ExpStm : public Stm {
 
   ExpStm(Exp* exp) : Stm(EXP), exp(exp) {}
   void Print(FILE* out, int d) const override;
-
-  /*Lab6 only*/
-  Stm* Canon(Stm*) override;
 };
 
 /*
@@ -157,9 +136,6 @@ class Exp {
 
   Exp(Kind kind) : kind(kind) {}
   virtual void Print(FILE* out, int d) const = 0;
-
-  /*Lab6 only*/
-  virtual C::StmAndExp Canon(Exp*) = 0;
 };
 
 class BinopExp : public Exp {
@@ -170,9 +146,6 @@ class BinopExp : public Exp {
   BinopExp(BinOp op, Exp* left, Exp* right)
       : Exp(BINOP), op(op), left(left), right(right) {}
   void Print(FILE* out, int d) const override;
-
-  /*Lab6 only*/
-  C::StmAndExp Canon(Exp*) override;
 };
 
 class MemExp : public Exp {
@@ -181,9 +154,6 @@ class MemExp : public Exp {
 
   MemExp(Exp* exp) : Exp(MEM), exp(exp) {}
   void Print(FILE* out, int d) const override;
-
-  /*Lab6 only*/
-  C::StmAndExp Canon(Exp*) override;
 };
 
 class TempExp : public Exp {
@@ -192,9 +162,6 @@ class TempExp : public Exp {
 
   TempExp(TEMP::Temp* temp) : Exp(TEMP), temp(temp) {}
   void Print(FILE* out, int d) const override;
-
-  /*Lab6 only*/
-  C::StmAndExp Canon(Exp*) override;
 };
 
 class EseqExp : public Exp {
@@ -204,9 +171,6 @@ class EseqExp : public Exp {
 
   EseqExp(Stm* stm, Exp* exp) : Exp(ESEQ), stm(stm), exp(exp) {}
   void Print(FILE* out, int d) const override;
-
-  /*Lab6 only*/
-  C::StmAndExp Canon(Exp*) override;
 };
 
 class NameExp : public Exp {
@@ -215,9 +179,6 @@ class NameExp : public Exp {
 
   NameExp(TEMP::Label* name) : Exp(NAME), name(name) {}
   void Print(FILE* out, int d) const override;
-
-  /*Lab6 only*/
-  C::StmAndExp Canon(Exp*) override;
 };
 
 class ConstExp : public Exp {
@@ -226,21 +187,17 @@ class ConstExp : public Exp {
 
   ConstExp(int consti) : Exp(CONST), consti(consti) {}
   void Print(FILE* out, int d) const override;
-
-  /*Lab6 only*/
-  C::StmAndExp Canon(Exp*) override;
 };
 
 class CallExp : public Exp {
  public:
   Exp* fun;
   ExpList* args;
+  bool tail;  // reuses the caller's frame, see F::F_procEntryExit3
 
-  CallExp(Exp* fun, ExpList* args) : Exp(CALL), fun(fun), args(args) {}
+  CallExp(Exp* fun, ExpList* args, bool tail = false)
+      : Exp(CALL), fun(fun), args(args), tail(tail) {}
   void Print(FILE* out, int d) const override;
-
-  /*Lab6 only*/
-  C::StmAndExp Canon(Exp*) override;
 };
 
 class ExpList {
@@ -0,0 +1,163 @@
+#ifndef TIGER_UTIL_FLATGRAPH_H_
+#define TIGER_UTIL_FLATGRAPH_H_
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <vector>
+
+namespace G {
+
+/*
+ * A directed graph over the dense node ids 0 .. NodeCount()-1, for the
+ * backend graphs that are built once and then only walked. While it is
+ * built each node keeps its edges in small vectors; Freeze() packs them
+ * into compressed sparse rows, sorted and without duplicates, after which
+ * no edge may be added. Succ, Pred and Adj return ranges into those
+ * arrays, so walking them allocates nothing.
+ */
+template <class T>
+class FlatGraph {
+ public:
+  /* A run of node ids; stays valid until the graph is changed */
+  class Range {
+   public:
+    Range(const int* b, const int* e) : b_(b), e_(e) {}
+    const int* begin() const { return b_; }
+    const int* end() const { return e_; }
+    int size() const { return e_ - b_; }
+    bool empty() const { return b_ == e_; }
+
+   private:
+    const int* b_;
+    const int* e_;
+  };
+
+  FlatGraph() : frozen_(false) {}
+
+  /* Make a new node with associated "info" and return its id */
+  int NewNode(T* info);
+
+  /* Make a new edge; duplicates are only dropped by Freeze */
+  void AddEdge(int from, int to);
+
+  /* Pack the edges into rows; the graph is read-only afterwards */
+  void Freeze();
+  bool Frozen() const { return frozen_; }
+
+  int NodeCount() const { return info_.size(); }
+  T* NodeInfo(int n) const { return info_[n]; }
+
+  Range Succ(int n) const;
+  Range Pred(int n) const;
+
+  /* Successors and predecessors, each once; only once frozen */
+  Range Adj(int n) const;
+
+  /* Tell if there is an edge from "from" to "to"; only once frozen */
+  bool GoesTo(int from, int to) const;
+
+  int InDegree(int n) const { return Pred(n).size(); }
+  int OutDegree(int n) const { return Succ(n).size(); }
+
+ private:
+  static Range Row(const std::vector<int>& off, const std::vector<int>& col,
+                   int n) {
+    return Range(col.data() + off[n], col.data() + off[n + 1]);
+  }
+  static Range Row(const std::vector<int>& v) {
+    return Range(v.data(), v.data() + v.size());
+  }
+
+  bool frozen_;
+  std::vector<T*> info_;
+
+  /* Edges while the graph is built */
+  std::vector<std::vector<int> > succs_;
+  std::vector<std::vector<int> > preds_;
+
+  /* Row i of each array is col[off[i]] .. col[off[i+1]-1] */
+  std::vector<int> succOff_, succCol_;
+  std::vector<int> predOff_, predCol_;
+  std::vector<int> adjOff_, adjCol_;
+};
+
+template <class T>
+int FlatGraph<T>::NewNode(T* info) {
+  assert(!frozen_);
+  info_.push_back(info);
+  succs_.emplace_back();
+  preds_.emplace_back();
+  return info_.size() - 1;
+}
+
+template <class T>
+void FlatGraph<T>::AddEdge(int from, int to) {
+  assert(!frozen_);
+  assert(from >= 0 && from < NodeCount() && to >= 0 && to < NodeCount());
+  succs_[from].push_back(to);
+  preds_[to].push_back(from);
+}
+
+template <class T>
+void FlatGraph<T>::Freeze() {
+  if (frozen_) return;
+  int n = NodeCount();
+
+  succOff_.assign(1, 0);
+  for (int i = 0; i < n; ++i) {
+    std::vector<int>& row = succs_[i];
+    std::sort(row.begin(), row.end());
+    row.erase(std::unique(row.begin(), row.end()), row.end());
+    succCol_.insert(succCol_.end(), row.begin(), row.end());
+    succOff_.push_back(succCol_.size());
+  }
+
+  // Filling the predecessor rows in order of their sources sorts them
+  predOff_.assign(n + 1, 0);
+  for (int to : succCol_) predOff_[to + 1]++;
+  for (int i = 0; i < n; ++i) predOff_[i + 1] += predOff_[i];
+  predCol_.resize(succCol_.size());
+  std::vector<int> fill(predOff_.begin(), predOff_.end() - 1);
+  for (int i = 0; i < n; ++i)
+    for (int to : Row(succOff_, succCol_, i)) predCol_[fill[to]++] = i;
+
+  adjOff_.assign(1, 0);
+  for (int i = 0; i < n; ++i) {
+    Range s = Row(succOff_, succCol_, i), p = Row(predOff_, predCol_, i);
+    std::set_union(s.begin(), s.end(), p.begin(), p.end(),
+                   std::back_inserter(adjCol_));
+    adjOff_.push_back(adjCol_.size());
+  }
+
+  std::vector<std::vector<int> >().swap(succs_);
+  std::vector<std::vector<int> >().swap(preds_);
+  frozen_ = true;
+}
+
+template <class T>
+typename FlatGraph<T>::Range FlatGraph<T>::Succ(int n) const {
+  return frozen_ ? Row(succOff_, succCol_, n) : Row(succs_[n]);
+}
+
+template <class T>
+typename FlatGraph<T>::Range FlatGraph<T>::Pred(int n) const {
+  return frozen_ ? Row(predOff_, predCol_, n) : Row(preds_[n]);
+}
+
+template <class T>
+typename FlatGraph<T>::Range FlatGraph<T>::Adj(int n) const {
+  assert(frozen_);
+  return Row(adjOff_, adjCol_, n);
+}
+
+template <class T>
+bool FlatGraph<T>::GoesTo(int from, int to) const {
+  assert(frozen_);
+  Range s = Succ(from);
+  return std::binary_search(s.begin(), s.end(), to);
+}
+
+}  // namespace G
+
+#endif
@@ -26,6 +26,9 @@ class Graph {
   to the same graph */
   static void AddEdge(Node<T>* from, Node<T>* to);
 
+  /* AddEdge for callers that know there is no such edge yet */
+  static void AddNewEdge(Node<T>* from, Node<T>* to);
+
   /* Delete the edge joining "from" and "to" */
   static void RmEdge(Node<T>* from, Node<T>* to);
 
@@ -132,6 +135,12 @@ void Graph<T>::AddEdge(Node<T>* from, Node<T>* to) {
   assert(to);
   assert(from->mygraph_ == to->mygraph_);
   if (from->GoesTo(to)) return;
+  AddNewEdge(from, to);
+}
+
+template <class T>
+void Graph<T>::AddNewEdge(Node<T>* from, Node<T>* to) {
+  assert(from->mygraph_ == to->mygraph_);
   to->preds_ = new NodeList<T>(from, to->preds_);
   from->succs_ = new NodeList<T>(to, from->succs_);
 }
@@ -0,0 +1,31 @@
+#ifndef TIGER_UTIL_OPTIONS_H_
+#define TIGER_UTIL_OPTIONS_H_
+
+#include <string>
+
+namespace U {
+
+/* Command line switches of tiger-compiler, filled in once by main() */
+class Options {
+ public:
+  int inlineBudget = 40;      // max IR nodes of an inlined body, 0 disables
+  bool inlineReport = false;  // one line on stderr per inlined call site
+  bool boundsCheck = false;   // check array subscripts not proven in range
+  bool allocProfile = false;  // pass a site id to every heap allocation
+  bool profile = false;       // count function entries at run time
+  bool profileBlocks = false; // and basic block entries
+  bool blockLayout = true;    // order traces by estimated block frequency
+  bool valueNumbering = true; // reuse values computed in dominating code
+  bool copyPropagation = true; // remove needless moves before allocation
+  bool schedule = true;       // list-schedule basic blocks before allocation
+  bool cachedLinks = false;   // load outer frame pointers once per call
+};
+
+inline Options& options() {
+  static Options opts;
+  return opts;
+}
+
+}  // namespace U
+
+#endif  // TIGER_UTIL_OPTIONS_H_